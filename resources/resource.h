@@ -6,6 +6,8 @@
 #define IDR_SHADER_DEF 301
 #define IDR_SHADER_CSG 302
 #define IDR_SHADER_RENDER 303
-#define IDR_SHADER_RENDEROUT 304
+#define IDR_SHADER_SCENE 305
+#define IDR_SHADER_FROZEN 306
+#define IDR_SHADER_FREEZE 307
 
 #define IDR_SYM_SCENE 401
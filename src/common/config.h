@@ -31,7 +31,40 @@
 
 enum class pipelineType {
     COMPUTE,
-    COMPUTE2
+    COMPUTE2,
+    COMPUTE_BAKED,
+    INTERPRETER
+};
+
+// How Scene::getShaderCode emits node values
+enum class codegenMode {
+    UNIFORM,    // everything is read from the node buffer
+    BAKED,      // literals, the selected subtree stays live in the node buffer
+    BAKED_ALL   // literals only, for final renders
+};
+
+// Specialization of render.comp, see vkUtil::get_render_quality
+enum class qualityTier {
+    INTERACTIVE,    // viewport while editing, AA follows the scene setting
+    PREVIEW,        // idle viewport, AA fixed at build time
+    FINAL           // image export
+};
+
+// What a dispatch of render.comp computes, see vkUtil::PassConstants
+enum class passMode {
+    RENDER,     // the viewport or an exported image, with split shading the viewport's hits only
+    SCENE_GRID, // the frame's empty space skipping grid
+    CONE,       // low resolution depth the viewport rays start from, and the class of every tile
+    SHADE,      // the viewport's color from the hits of the render pass, with split shading
+    LIGHTING    // AO and sun shadow of the viewport's hits at a reduced rate, read by the shading pass
+};
+
+// Which pixels a render dispatch draws, see Scene::TileLists
+enum class tileClass {
+    ALL,        // every pixel of the dispatch grid
+    EMPTY,      // tiles whose rays cannot reach the scene, background and grid only
+    SIMPLE,     // tiles that took few steps in the frame before, with a smaller step budget
+    COMPLEX     // the remaining tiles
 };
 
 enum class popupStates {
@@ -50,3 +83,10 @@ std::vector<std::string> split(std::string line, std::string delimiter);
 float random_float();
 
 float random_float(float min, float max);
+
+// Hashing functions
+
+template <typename T>
+inline void hash_combine(size_t& seed, const T& value) {
+    seed ^= std::hash<T>{}(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
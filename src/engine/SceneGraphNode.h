@@ -27,6 +27,8 @@ struct NodeData {
 	glm::mat4 transform; 
 	glm::mat4 object;
 	glm::vec4 color;
+	glm::mat3x4 invWorld; // derived from transform every update, not serialized
+	glm::vec4 bound; // world space bounding sphere, center and radius, derived every update, not serialized
 
 	bool operator==(const NodeData& other) const {
 		return data0 == other.data0 &&
@@ -122,6 +122,23 @@ public:
 		return m_parentTransform;
 	}
 
+    // World rotation as a quaternion, the rotation rotateChild applies to children
+    static glm::quat worldRotation(const glm::mat4& worldTransform) {
+        return glm::quat(glm::radians(glm::vec3(worldTransform[1])));
+    }
+
+    // World to local space as used by the shaders: vec4(p, 1.0) * inverseWorld.
+    // Column j holds row j of the inverse rotation and the matching inverse translation in w.
+    static glm::mat3x4 inverseWorldMatrix(const glm::mat4& worldTransform) {
+        glm::mat3 rotation = glm::mat3_cast(worldRotation(worldTransform));
+        glm::vec3 position = glm::vec3(worldTransform[2]);
+        glm::mat3x4 inverse;
+        for (int j = 0; j < 3; j++) {
+            inverse[j] = glm::vec4(rotation[j], -glm::dot(rotation[j], position));
+        }
+        return inverse;
+    }
+
     glm::vec3 rotateChild(const glm::vec3 parentPos, const glm::vec3 parentRot, const glm::vec3 childLocalPos) {
         glm::vec3 parentWorldRotationRadians = glm::radians(parentRot);
         glm::quat parentWorldRotationQuat = glm::quat(parentWorldRotationRadians);
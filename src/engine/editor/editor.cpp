@@ -280,7 +280,7 @@ void Editor::DrawSceneGraphNode(SceneGraphNode* node, bool draw, bool destroy, S
 			    else if (node->getBoolOperation() == BoolOperatios::Intersection) { pre = ICON_LC_SQUARE_SLASH " "; }
 			    else if (node->getBoolOperation() == BoolOperatios::Difference) { pre = ICON_LC_SQUARE_MINUS " "; }
 
-                if (isGroup) { pre += ICON_LC_BOXES " "; }
+                if (isGroup) { pre += scene->isFrozen(id) ? ICON_LC_BOX " " : ICON_LC_BOXES " "; }
 				else { 
                     switch (node->getObject()->getComponent<Shape>()->getType())
                     {
@@ -345,6 +345,23 @@ void Editor::DrawSceneGraphNode(SceneGraphNode* node, bool draw, bool destroy, S
                         ImGui::EndMenu();
                     }
                 }
+                if (isGroup && id != 0)
+                {
+                    // Frozen groups are drawn from a baked volume until they are unfrozen
+                    if (scene->isFrozen(id))
+                    {
+                        if (ImGui::Selectable(ICON_LC_BOXES " Unfreeze"))
+                        {
+                            scene->unfreezeGroup(id);
+                            ImGui::CloseCurrentPopup();
+                        }
+                    }
+                    else if (ImGui::Selectable(ICON_LC_BOX " Freeze"))
+                    {
+                        scene->freezeGroup(id);
+                        ImGui::CloseCurrentPopup();
+                    }
+                }
                 if (id != 0)
                 {
                     if (ImGui::Selectable(ICON_LC_TRASH_2 " Delete Object"))
@@ -835,6 +852,30 @@ void Editor::getSettings(Scene* scene)
         ImGui::Separator();
         ImGui::Spacing();
 
+        ImGui::PushFont(ImGui::GetIO().Fonts->Fonts[1]);
+        ImGui::Text(ICON_LC_MOUNTAIN " Shading LOD Distance (0 = off)");
+        ImGui::PopFont();
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+        float lodDistance = scene->getLodDistance();
+        if (ImGui::DragFloat("##LodDistance", &lodDistance, 0.1f, 0.0f, 20.0f, "%.1f")) {
+            scene->setLodDistance(lodDistance);
+        }
+
+        ImGui::Spacing();
+
+        ImGui::PushFont(ImGui::GetIO().Fonts->Fonts[1]);
+        ImGui::Text(ICON_LC_SCAN " Shading LOD Pixel Footprint (0 = off)");
+        ImGui::PopFont();
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+        float lodFootprint = scene->getLodFootprint();
+        if (ImGui::DragFloat("##LodFootprint", &lodFootprint, 0.001f, 0.0f, 0.5f, "%.3f")) {
+            scene->setLodFootprint(lodFootprint);
+        }
+
+        ImGui::Spacing();
+        ImGui::Separator();
+        ImGui::Spacing();
+
         ImGui::PushFont(ImGui::GetIO().Fonts->Fonts[1]);
         ImGui::Text(ICON_LC_VIDEO " Camera Position");
         ImGui::PopFont();
@@ -878,6 +919,12 @@ void Editor::getSettings(Scene* scene)
             scene->showGrid(int(showGridBool));
         }
 
+        ImGui::PushFont(ImGui::GetIO().Fonts->Fonts[1]);
+        ImGui::Text(ICON_LC_MINUS " Idle Frame Rate");
+        ImGui::PopFont();
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+        ImGui::SliderInt("##IdleFrameRate", &m_idleFrameRate, 1, 60, "%d", ImGuiSliderFlags_AlwaysClamp);
+
 	}
 }
 
@@ -1118,7 +1165,53 @@ void Editor::MenuBar(Scene* scene)
             if (ImGui::SliderFloat("##CamOrbSpeed", &scene->m_orbitSpeed, 0.1f, 2.0f))
             {
             }
-            
+
+            ImGui::Spacing();
+
+            ImGui::PushFont(ImGui::GetIO().Fonts->Fonts[1]);
+            ImGui::Text(ICON_LC_BRACES " Group Functions (min nodes, 0 = off)");
+            ImGui::PopFont();
+            ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+            int groupFunctionMinNodes = scene->getGroupFunctionMinNodes();
+            if (ImGui::InputInt("##GroupFunctions", &groupFunctionMinNodes))
+            {
+                scene->setGroupFunctionMinNodes(std::max(groupFunctionMinNodes, 0));
+            }
+
+            ImGui::Spacing();
+
+            ImGui::PushFont(ImGui::GetIO().Fonts->Fonts[1]);
+            ImGui::Text(ICON_LC_BOX_SELECT " Bounds Culling");
+            ImGui::PopFont();
+            bool boundsCulling = scene->getBoundsCulling();
+            if (ImGui::Checkbox("##BoundsCulling", &boundsCulling))
+            {
+                scene->setBoundsCulling(boundsCulling);
+            }
+
+            ImGui::Spacing();
+
+            ImGui::PushFont(ImGui::GetIO().Fonts->Fonts[1]);
+            ImGui::Text(ICON_LC_SIGMA " Analytic Normals");
+            ImGui::PopFont();
+            bool analyticGradients = scene->getAnalyticGradients();
+            if (ImGui::Checkbox("##AnalyticGradients", &analyticGradients))
+            {
+                scene->setAnalyticGradients(analyticGradients);
+            }
+
+            ImGui::Spacing();
+
+            ImGui::PushFont(ImGui::GetIO().Fonts->Fonts[1]);
+            ImGui::Text(ICON_LC_NETWORK " BVH (min objects, 0 = off)");
+            ImGui::PopFont();
+            ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+            int bvhMinObjects = scene->getBvhMinObjects();
+            if (ImGui::InputInt("##BvhMinObjects", &bvhMinObjects))
+            {
+                scene->setBvhMinObjects(std::max(bvhMinObjects, 0));
+            }
+
             ImGui::EndMenu();
         }
         if (ImGui::BeginMenu("Render"))
@@ -31,6 +31,7 @@ public:
 	bool getRenderImage() {return m_renderImage;}
 	void setRenderImage(bool renderImage) {m_renderImage = renderImage;}
 	glm::vec2 getImageSize() {return m_imageSize;}
+	int getIdleFrameRate() {return m_idleFrameRate;}
 private:
 	glm::vec4 xColor = glm::vec4(0.000f, 1.000f, 0.557f, 1.000f);
 	glm::vec4 yColor = glm::vec4(1.000f, 0.000f, 0.502f, 1.000f);
@@ -39,6 +40,7 @@ private:
 	bool m_isMovingElement = false;
 	bool m_renderImage = false;
 	glm::ivec2 m_imageSize = glm::ivec2(2048, 2048);
+	int m_idleFrameRate = 10; // frames per second drawn while nothing changes
 	std::string m_defaultCode = "Please select an object to see and edit its code!";
 	int m_selectedCode = 0;
 	int m_shaderCodeLinesOffset = 0;
@@ -12,12 +12,23 @@ int main(int argc, char* argv[])
 {
     auto args = parseCommandLineArgs(argc, argv);
     std::string filename = "";
-    if (args.size() > 1) {
-        filename = args[1];
+    bool benchmark = false;
+    for (size_t i = 1; i < args.size(); ++i) {
+        if (args[i] == "--benchmark-codegen") {
+            benchmark = true;
+        }
+        else {
+            filename = args[i];
+        }
     }
     Window* renderView = new Window(1280, 720, false, filename);
     
-    renderView->run();
+    if (benchmark) {
+        renderView->benchmark();
+    }
+    else {
+        renderView->run();
+    }
     delete renderView;
 
 	return 0;
@@ -69,6 +69,10 @@ bool isShiftPressed(SDL_Keymod mod) {
     return (mod & KMOD_LSHIFT) != 0;
 }
 
+void Window::benchmark() {
+    _engine->runCodegenBenchmark(_scene);
+}
+
 void Window::run() {
     bool bQuit = false;
     render = true;
@@ -114,7 +118,10 @@ void Window::run() {
            _scene->endAction();
        }
 
-       if (SDL_PollEvent(&e)) {
+       // While nothing changes only the idle frame rate is drawn, any event wakes the loop up
+       bool gotEvent = (_activeFrames > 0) ? SDL_PollEvent(&e) : SDL_WaitEventTimeout(&e, 1000 / std::max(1, _editor->getIdleFrameRate()));
+       if (gotEvent) {
+            _activeFrames = _settleFrames;
 
             if (e.type == SDL_QUIT)
             {
@@ -201,7 +208,9 @@ void Window::run() {
         ImGui_ImplVulkan_NewFrame();
         ImGui_ImplSDL2_NewFrame();
         ImGui::NewFrame();
-        snprintf(_windowTitle, sizeof(_windowTitle), "SYMYS | FPS: %.0f", ImGui::GetIO().Framerate);
+        glm::vec4 passTimes = _engine->getPassTimes();
+        snprintf(_windowTitle, sizeof(_windowTitle), "SYMYS | FPS: %.0f | cone %.2f ms, march %.2f ms, lighting %.2f ms, shade %.2f ms",
+            ImGui::GetIO().Framerate, passTimes.x, passTimes.y, passTimes.z, passTimes.w);
         ImGuiIO& io = ImGui::GetIO(); (void)io;
         if (!io.WantCaptureMouse && SDL_GetMouseState(NULL, NULL) & SDL_BUTTON(SDL_BUTTON_LEFT))
         {
@@ -300,6 +309,14 @@ void Window::run() {
 			_engine->recompile_shader();
 		}
         calcFramerate();
+
+        // ImGui takes a few frames to settle after input, the engine until its passes converge
+        _activeFrames = std::max(_activeFrames - 1, 0);
+        bool popupVisible = _engine->isPopupVisible();
+        if (!_engine->isIdle(_scene) || SDL_GetRelativeMouseMode() || ImGui::IsAnyItemActive() || popupVisible != _lastPopupVisible) {
+            _activeFrames = std::max(_activeFrames, 1);
+        }
+        _lastPopupVisible = popupVisible;
         SDL_Delay(1);
     }
 }
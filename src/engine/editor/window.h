@@ -11,7 +11,7 @@ private:
     Editor* _editor;
     SDL_Event e;
     Scene* _scene;
-    char _windowTitle[100];
+    char _windowTitle[128];
     bool _isInitialized = false;
     std::atomic<bool> render = false;
     bool openAddPanel = false;
@@ -20,6 +20,10 @@ private:
     int _numFrames;
     float _frameDelay;
     int _frameCap = 120;
+    // frames still drawn after the last event or change before the loop waits for events
+    int _activeFrames = 0;
+    static const int _settleFrames = 3;
+    bool _lastPopupVisible = false;
     int _deltaTime;
     float _framerate;
     
@@ -35,4 +39,5 @@ public:
     Window(int widht, int height, bool debug, std::string filename = "");
     ~Window();
     void run();
+    void benchmark();
 };
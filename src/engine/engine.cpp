@@ -8,6 +8,9 @@
 #include "vulkan/vkInit/commands.h"
 #include "vulkan/vkInit/sync.h"
 #include "vulkan/vkInit/descriptors.h"
+#include "vulkan/vkInit/pipeline_cache.h"
+#include "vulkan/vkInit/workgroup_size.h"
+#include "vulkan/vkUtil/spirv_cache.h"
 #include "glslang/Public/ShaderLang.h"
 #include "vulkan/vkImage/lodepng.h"
 #include "tinyfiledialogs.h"
@@ -27,10 +30,18 @@ Engine::Engine(int width, int height, SDL_Window* window, Scene* scene) {
 	make_device(scene);
 	glslang::InitializeProcess();
 	make_descriptor_set_layouts(scene);
+	m_pipelineCachePath = vkUtil::getExecutableDirectory() + "/pipeline_cache.bin";
+	m_pipelineCache = vkInit::make_pipeline_cache(m_device, m_physicalDevice, m_pipelineCachePath);
+	m_workgroupSizePath = vkUtil::getExecutableDirectory() + "/workgroup_size.txt";
+	bool tuned = vkInit::load_workgroup_size(m_physicalDevice, m_workgroupSizePath, m_workgroupSize);
 	make_pipelines();
 	finalize_setup(scene);
 	make_assets(scene);
+	if (!tuned) {
+		tune_workgroup_size(scene);
+	}
     init_imgui();
+	m_compileThread = std::thread(&Engine::compile_worker, this, m_frameSetLayout[pipelineType::COMPUTE]);
 }
 
 void Engine::make_instance() {
@@ -52,6 +63,7 @@ void Engine::make_instance() {
 void Engine::make_device(Scene* scene) {
 	m_physicalDevice = vkInit::choose_physical_device(m_instance);;
 	m_device = vkInit::create_logical_device(m_physicalDevice, m_surface);
+	m_creationFeedback = vkInit::supports_creation_feedback(m_physicalDevice);
 	std::array<vk::Queue, 2> queues = vkInit::get_queues(m_physicalDevice, m_device, m_surface);
 	m_graphicsQueue = queues[0];
 	m_presentQueue = queues[1];
@@ -93,6 +105,8 @@ void Engine::recreate_swapchain(Scene* scene) {
 	make_frame_resources(scene);
 	vkInit::commandBufferInputChunk commandBufferInput = { m_device, m_commandPool, m_swapchainFrames };
 	vkInit::make_frame_command_buffers(commandBufferInput);
+	// the new frames start with empty brick pools
+	scene->needsFreezeBake = true;
 
 }
 
@@ -100,7 +114,7 @@ void Engine::make_descriptor_set_layouts(Scene* scene) {
 
 	//Binding once per frame
 	vkInit::descriptorSetLayoutData bindings;
-	bindings.count = scene->buffers.size()+1;
+	bindings.count = scene->buffers.size() + m_frameImages.size() + 1;
 
 	bindings.indices.push_back(0);
 	bindings.types.push_back(vk::DescriptorType::eStorageImage);
@@ -115,6 +129,13 @@ void Engine::make_descriptor_set_layouts(Scene* scene) {
 		bindings.stages.push_back(vk::ShaderStageFlagBits::eCompute);
 		index++;
 	}
+	for (size_t i = 0; i < m_frameImages.size(); i++) {
+		bindings.indices.push_back(index);
+		bindings.types.push_back(vk::DescriptorType::eStorageImage);
+		bindings.counts.push_back(1);
+		bindings.stages.push_back(vk::ShaderStageFlagBits::eCompute);
+		index++;
+	}
 
 	m_frameSetLayout[pipelineType::COMPUTE] = vkInit::make_descriptor_set_layout(m_device, bindings);
 
@@ -123,28 +144,147 @@ void Engine::make_descriptor_set_layouts(Scene* scene) {
 void Engine::make_pipelines() {
 	vkInit::ComputePipelineBuilder computePipelineBuilder(m_device);
 	m_computePipelineBuilder = computePipelineBuilder;
-
-	m_computePipelineBuilder.specify_compute_shader(m_scene->getShaderCode().c_str());
+	m_computePipelineBuilder.set_pipeline_cache(m_pipelineCache);
+	m_computePipelineBuilder.set_creation_feedback(m_creationFeedback);
+	m_computePipelineBuilder.set_workgroup_size(m_workgroupSize);
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	m_scene->updateBvh();
+	m_sceneShaderCode = m_scene->getShaderCode();
+	m_activeShaderCode = m_sceneShaderCode;
+	m_activeNodeData = m_scene->GetNodeData();
+	m_activeBvh = *m_scene->GetBvhPtr();
+	m_computePipelineBuilder.specify_compute_shader(m_sceneShaderCode.c_str());
 	m_computePipelineBuilder.add_descriptor_set_layout(m_frameSetLayout[pipelineType::COMPUTE]);
 
 	vkInit::ComputePipelineOutBundle computeOutput = m_computePipelineBuilder.build();
 
 	m_pipelineLayout[pipelineType::COMPUTE] = computeOutput.layout;
 	m_pipeline[pipelineType::COMPUTE] = computeOutput.pipeline;
+	m_pipelineQuality[pipelineType::COMPUTE] = computeOutput.quality;
 	m_computePipelineBuilder.reset();
 
-	m_computePipelineBuilder.specify_compute_shader(m_scene->getShaderCode().c_str());
+	m_computePipelineBuilder.specify_compute_shader(m_sceneShaderCode.c_str());
 	m_computePipelineBuilder.add_descriptor_set_layout(m_frameSetLayout[pipelineType::COMPUTE]);
 
 	vkInit::ComputePipelineOutBundle computeOutputSecond = m_computePipelineBuilder.build();
 
 	m_pipelineLayout[pipelineType::COMPUTE2] = computeOutputSecond.layout;
 	m_pipeline[pipelineType::COMPUTE2] = computeOutputSecond.pipeline;
+	m_pipelineQuality[pipelineType::COMPUTE2] = computeOutputSecond.quality;
 	m_computePipelineBuilder.reset();
 
+	m_interpreterShaderCode = m_scene->getInterpreterShaderCode();
+	m_scene->updateBytecode();
+	make_interpreter_pipeline();
+
+	std::stringstream message;
+	message << "Startup pipelines built in " << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count() << " ms";
+	vkLogging::Logger::get_logger()->print(message.str());
+
 	vkInit::PipelineBuilder pipelineBuilder(m_device);
 }
 
+void Engine::tune_workgroup_size(Scene* scene) {
+
+	vk::PhysicalDeviceProperties properties = m_physicalDevice.getProperties();
+	if (!properties.limits.timestampComputeAndGraphics) {
+		vkLogging::Logger::get_logger()->print("Device has no compute timestamps, keeping the default workgroup size");
+		return;
+	}
+
+	// The candidates draw the first frame into an image of their own, no swapchain image is acquired yet
+	vkUtil::SwapChainFrame& frame = m_swapchainFrames[0];
+	createHighResImage(m_swapchainExtent.width, m_swapchainExtent.height);
+	vk::DescriptorImageInfo target(nullptr, m_highResImageView, vk::ImageLayout::eGeneral);
+	m_device.updateDescriptorSets(vk::WriteDescriptorSet(frame.descriptorSet[pipelineType::COMPUTE], 0, 0, 1, vk::DescriptorType::eStorageImage, &target), nullptr);
+	vk::QueryPool queries = m_device.createQueryPool(vk::QueryPoolCreateInfo(vk::QueryPoolCreateFlags(), vk::QueryType::eTimestamp, 2));
+
+	pipelineType type = active_pipeline_type();
+	vkInit::ComputePipelineOutBundle active = { m_pipelineLayout[type], m_pipeline[type], m_pipelineQuality[type] };
+	glm::uvec2 defaultSize = m_workgroupSize;
+	glm::uvec2 best = m_workgroupSize;
+	double bestTime = std::numeric_limits<double>::max();
+	for (glm::uvec2 candidate : m_workgroupCandidates) {
+		if (candidate.x * candidate.y > properties.limits.maxComputeWorkGroupInvocations
+			|| candidate.x > properties.limits.maxComputeWorkGroupSize[0] || candidate.y > properties.limits.maxComputeWorkGroupSize[1]) {
+			continue;
+		}
+		m_computePipelineBuilder.set_workgroup_size(candidate);
+		m_computePipelineBuilder.specify_compute_shader(m_sceneShaderCode.c_str());
+		m_computePipelineBuilder.add_descriptor_set_layout(m_frameSetLayout[pipelineType::COMPUTE]);
+		vkInit::ComputePipelineOutBundle bundle = m_computePipelineBuilder.build();
+		m_computePipelineBuilder.reset();
+		if (!bundle.pipeline) {
+			destroy_pipeline(bundle);
+			continue;
+		}
+
+		m_pipelineLayout[type] = bundle.layout;
+		m_pipeline[type] = bundle.pipeline;
+		m_pipelineQuality[type] = bundle.quality;
+		m_workgroupSize = candidate;
+		immediate_submit([&](vk::CommandBuffer cmd) {
+			prepare_to_trace_barrier(cmd, m_highResImage);
+			cmd.resetQueryPool(queries, 0, 2);
+			// the first frame also fills the scene grid for this pipeline
+			dispatch_compute(cmd, 0, scene->m_viewport, false);
+			cmd.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, queries, 0);
+			for (int i = 0; i < m_tuningRuns; i++) {
+				dispatch_compute(cmd, 0, scene->m_viewport, false);
+			}
+			cmd.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, queries, 1);
+		});
+		uint64_t timestamps[2] = {};
+		vk::Result result = m_device.getQueryPoolResults(queries, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+			vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+		destroy_pipeline(bundle);
+		if (result != vk::Result::eSuccess) {
+			continue;
+		}
+
+		double time = double(timestamps[1] - timestamps[0]) * properties.limits.timestampPeriod / 1000000.0 / m_tuningRuns;
+		std::stringstream message;
+		message << "Workgroup size " << candidate.x << "x" << candidate.y << ": " << time << " ms per frame";
+		vkLogging::Logger::get_logger()->print(message.str());
+		if (time < bestTime) {
+			bestTime = time;
+			best = candidate;
+		}
+	}
+
+	m_pipelineLayout[type] = active.layout;
+	m_pipeline[type] = active.pipeline;
+	m_pipelineQuality[type] = active.quality;
+	m_workgroupSize = best;
+	m_device.updateDescriptorSets(vk::WriteDescriptorSet(frame.descriptorSet[pipelineType::COMPUTE], 0, 0, 1, vk::DescriptorType::eStorageImage, &frame.colorBufferDescriptor), nullptr);
+	m_device.destroyQueryPool(queries);
+	m_device.destroyImageView(m_highResImageView);
+	m_device.destroyImage(m_highResImage);
+	m_device.freeMemory(m_highResImageMemory);
+
+	// Nothing the candidates left in the frame's grid and images can be trusted, their pipelines are gone
+	m_historyFrame = -1;
+	m_accumulatedSamples = 0;
+	m_sceneGridRebuild.assign(m_swapchainFrames.size(), true);
+	m_sceneGridPipeline.assign(m_swapchainFrames.size(), nullptr);
+
+	std::stringstream message;
+	message << "Tuned workgroup size " << best.x << "x" << best.y;
+	vkLogging::Logger::get_logger()->print(message.str());
+	vkInit::save_workgroup_size(m_physicalDevice, m_workgroupSizePath, best);
+	if (best != defaultSize) {
+		m_device.destroyPipeline(m_pipeline[pipelineType::COMPUTE]);
+		m_device.destroyPipelineLayout(m_pipelineLayout[pipelineType::COMPUTE]);
+		m_device.destroyPipeline(m_pipeline[pipelineType::COMPUTE2]);
+		m_device.destroyPipelineLayout(m_pipelineLayout[pipelineType::COMPUTE2]);
+		make_pipelines();
+	}
+	else {
+		m_computePipelineBuilder.set_workgroup_size(best);
+	}
+}
+
 void Engine::finalize_setup(Scene* scene) {
 
 	m_commandPool = vkInit::make_command_pool(m_device, m_physicalDevice, m_surface);
@@ -166,12 +306,15 @@ void Engine::finalize_setup(Scene* scene) {
 void Engine::make_frame_resources(Scene* scene) {
 
 	vkInit::descriptorSetLayoutData bindings;
-	bindings.count = scene->buffers.size() + 1;
+	bindings.count = scene->buffers.size() + m_frameImages.size() + 1;
 	bindings.types.push_back(vk::DescriptorType::eStorageImage);
 
 	for (BufferInitParams buff : scene->buffers) {
 		bindings.types.push_back(buff.descriptorType);
 	}
+	for (size_t i = 0; i < m_frameImages.size(); i++) {
+		bindings.types.push_back(vk::DescriptorType::eStorageImage);
+	}
 
 	m_frameDescriptorPool[pipelineType::COMPUTE] = vkInit::make_descriptor_pool(m_device, static_cast<uint32_t>(m_swapchainFrames.size()), bindings);
 
@@ -181,11 +324,46 @@ void Engine::make_frame_resources(Scene* scene) {
 		frame.renderFinished = vkInit::make_semaphore(m_device);
 		frame.inFlight = vkInit::make_fence(m_device);
 
+		frame.AddImages(m_frameImages, m_device, m_physicalDevice);
 		frame.make_descriptor_resources(m_device, m_physicalDevice);
 		frame.descriptorSet[pipelineType::COMPUTE] = vkInit::allocate_descriptor_set(m_device, m_frameDescriptorPool[pipelineType::COMPUTE], m_frameSetLayout[pipelineType::COMPUTE]);
 		frame.record_write_operations();
 	}
 
+	// Frame images stay in general layout for their whole life
+	immediate_submit([&](vk::CommandBuffer cmd) {
+		std::vector<vk::ImageMemoryBarrier> barriers;
+		for (vkUtil::SwapChainFrame& frame : m_swapchainFrames) {
+			for (vkUtil::FrameImage& frameImage : frame.images) {
+				if (frameImage.previous >= 0) {
+					continue;
+				}
+				vk::ImageMemoryBarrier barrier = {};
+				barrier.oldLayout = vk::ImageLayout::eUndefined;
+				barrier.newLayout = vk::ImageLayout::eGeneral;
+				barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.image = frameImage.image;
+				barrier.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+				barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+				barriers.push_back(barrier);
+			}
+		}
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), nullptr, nullptr, barriers);
+	});
+
+	vk::PhysicalDeviceProperties properties = m_physicalDevice.getProperties();
+	m_timestampPeriod = properties.limits.timestampPeriod;
+	if (properties.limits.timestampComputeAndGraphics) {
+		m_passQueries = m_device.createQueryPool(vk::QueryPoolCreateInfo(vk::QueryPoolCreateFlags(), vk::QueryType::eTimestamp, m_maxFramesInFlight * m_passQueryCount));
+	}
+	m_passQueriesWritten.assign(m_maxFramesInFlight, false);
+
+	m_historyFrame = -1;
+	m_sceneGridPending.assign(m_swapchainFrames.size(), std::vector<glm::vec4>());
+	m_sceneGridRebuild.assign(m_swapchainFrames.size(), true);
+	m_sceneGridPipeline.assign(m_swapchainFrames.size(), nullptr);
+
 }
 
 void Engine::make_assets(Scene* scene) {
@@ -254,7 +432,7 @@ void Engine::createHighResImage(uint32_t width, uint32_t height) {
 void Engine::createHgihResComputePipeline(vk::ShaderModule computeShaderModule, Scene* scene) {
 	// Descriptor Layout
 	vkInit::descriptorSetLayoutData bindings;
-	bindings.count = scene->buffers.size() + 1;
+	bindings.count = scene->buffers.size() + m_frameImages.size() + 1;
 
 	bindings.indices.push_back(0);
 	bindings.types.push_back(vk::DescriptorType::eStorageImage);
@@ -269,23 +447,40 @@ void Engine::createHgihResComputePipeline(vk::ShaderModule computeShaderModule,
 		bindings.stages.push_back(vk::ShaderStageFlagBits::eCompute);
 		index++;
 	}
+	for (size_t i = 0; i < m_frameImages.size(); i++) {
+		bindings.indices.push_back(index);
+		bindings.types.push_back(vk::DescriptorType::eStorageImage);
+		bindings.counts.push_back(1);
+		bindings.stages.push_back(vk::ShaderStageFlagBits::eCompute);
+		index++;
+	}
 
 	m_HighResDescriptorSetLayout = vkInit::make_descriptor_set_layout(m_device, bindings);
 
 	vk::PipelineLayoutCreateInfo pipelineLayoutInfo = {};
 	pipelineLayoutInfo.setLayoutCount = 1;
 	pipelineLayoutInfo.pSetLayouts = &m_HighResDescriptorSetLayout;
+	vk::PushConstantRange passRange(vk::ShaderStageFlagBits::eCompute, 0, sizeof(vkUtil::PassConstants));
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &passRange;
 
 	m_HighResPipelineLayout = m_device.createPipelineLayout(pipelineLayoutInfo);
 
+	vkUtil::RenderQuality quality = vkUtil::get_render_quality(qualityTier::FINAL);
+	quality.localSizeX = m_workgroupSize.x;
+	quality.localSizeY = m_workgroupSize.y;
+	std::vector<vk::SpecializationMapEntry> specializationEntries = vkUtil::render_quality_map_entries();
+	vk::SpecializationInfo specializationInfo(static_cast<uint32_t>(specializationEntries.size()), specializationEntries.data(), sizeof(quality), &quality);
+
 	vk::ComputePipelineCreateInfo pipelineInfo = {};
 	pipelineInfo.stage = vk::PipelineShaderStageCreateInfo()
 		.setStage(vk::ShaderStageFlagBits::eCompute)
 		.setModule(computeShaderModule)
-		.setPName("main");
+		.setPName("main")
+		.setPSpecializationInfo(&specializationInfo);
 	pipelineInfo.layout = m_HighResPipelineLayout;
 
-	m_HighResComputePipeline = m_device.createComputePipeline(nullptr, pipelineInfo).value;
+	m_HighResComputePipeline = m_device.createComputePipeline(m_pipelineCache, pipelineInfo).value;
 }
 
 vk::CommandBuffer Engine::allocateHighResCommandBuffer(vk::CommandPool commandPool) {
@@ -307,8 +502,10 @@ void Engine::dispatchHighResCompute(vk::CommandPool commandPool, vk::Queue compu
 
 	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_HighResComputePipeline);
 	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_HighResPipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+	vkUtil::PassConstants pass = { int32_t(passMode::RENDER), VK_FALSE };
+	commandBuffer.pushConstants(m_HighResPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(pass), &pass);
 
-	commandBuffer.dispatch((width + 7) / 8, (height +7) / 8, 1);
+	commandBuffer.dispatch((width + m_workgroupSize.x - 1) / m_workgroupSize.x, (height + m_workgroupSize.y - 1) / m_workgroupSize.y, 1);
 
 	commandBuffer.end();
 
@@ -433,6 +630,63 @@ void Engine::setPopupText(std::string text, popupStates state) {
 	showPopup = true;
 }
 
+vk::DescriptorPool Engine::createHighResDescriptorPool(Scene* scene) {
+	vkInit::descriptorSetLayoutData bindings;
+	bindings.count = scene->buffers.size() + m_frameImages.size() + 1;
+	bindings.types.push_back(vk::DescriptorType::eStorageImage);
+
+	for (BufferInitParams buff : scene->buffers) {
+		bindings.types.push_back(buff.descriptorType);
+	}
+	for (size_t i = 0; i < m_frameImages.size(); i++) {
+		bindings.types.push_back(vk::DescriptorType::eStorageImage);
+	}
+
+	return vkInit::make_descriptor_pool(m_device, static_cast<uint32_t>(m_swapchainFrames.size()), bindings);
+}
+
+void Engine::writeHighResDescriptorSet(vk::DescriptorSet descriptorSet) {
+	vk::DescriptorImageInfo imageInfo = {};
+	imageInfo.imageView = m_highResImageView;
+	imageInfo.imageLayout = vk::ImageLayout::eGeneral;
+
+	std::vector<vk::WriteDescriptorSet> writeOps;
+
+	vk::WriteDescriptorSet descriptorWrite = {};
+	descriptorWrite.dstSet = descriptorSet;
+	descriptorWrite.dstBinding = 0;
+	descriptorWrite.dstArrayElement = 0;
+	descriptorWrite.descriptorType = vk::DescriptorType::eStorageImage;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.pImageInfo = &imageInfo;
+	writeOps.push_back(descriptorWrite);
+
+	for (auto& bufferSetup : m_swapchainFrames[0].bufferSetups) {
+		vk::WriteDescriptorSet bufferOp;
+		bufferOp.dstSet = descriptorSet;
+		bufferOp.dstBinding = bufferSetup.dstBinding;
+		bufferOp.dstArrayElement = 0; //byte offset within binding for inline uniform blocks
+		bufferOp.descriptorCount = 1;
+		bufferOp.descriptorType = bufferSetup.descriptorType;
+		bufferOp.pBufferInfo = &bufferSetup.buffer.descriptor;
+		writeOps.push_back(bufferOp);
+	}
+
+	// The final tier does not read the frame images, they only complete the layout
+	for (auto& frameImage : m_swapchainFrames[0].images) {
+		vk::WriteDescriptorSet imageOp;
+		imageOp.dstSet = descriptorSet;
+		imageOp.dstBinding = frameImage.dstBinding;
+		imageOp.dstArrayElement = 0;
+		imageOp.descriptorCount = 1;
+		imageOp.descriptorType = vk::DescriptorType::eStorageImage;
+		imageOp.pImageInfo = &frameImage.descriptor;
+		writeOps.push_back(imageOp);
+	}
+
+	m_device.updateDescriptorSets(writeOps, nullptr);
+}
+
 void Engine::renderHighResImage(Scene* scene, uint32_t width, uint32_t height) {
 	const char* filters[] = { "*.png" };
 	std::string name = scene->getFilename();
@@ -463,50 +717,14 @@ void Engine::renderHighResImage(Scene* scene, uint32_t width, uint32_t height) {
 	}
 
 	createHighResImage(width, height);
-	std::string shaderCode = scene->getShaderCode();
-	createHgihResComputePipeline(vkUtil::createModule(shaderCode, m_device, true), scene);
+	std::string shaderCode = scene->getShaderCode(codegenMode::BAKED_ALL);
+	createHgihResComputePipeline(vkUtil::createModule(shaderCode, m_device), scene);
 	createReadBackBuffer(width * height * 4); // Assuming 4 bytes per pixel (R8G8B8A8)
 
 	// Descriptor Set
-	vkInit::descriptorSetLayoutData bindings2;
-	bindings2.count = scene->buffers.size() + 1;
-	bindings2.types.push_back(vk::DescriptorType::eStorageImage);
-
-	for (BufferInitParams buff : scene->buffers) {
-		bindings2.types.push_back(buff.descriptorType);
-	}
-
-	vk::DescriptorPool descPool = vkInit::make_descriptor_pool(m_device, static_cast<uint32_t>(m_swapchainFrames.size()), bindings2);
-
+	vk::DescriptorPool descPool = createHighResDescriptorPool(scene);
 	vk::DescriptorSet descriptorSet = vkInit::allocate_descriptor_set(m_device, descPool, m_HighResDescriptorSetLayout);
-
-	vk::DescriptorImageInfo imageInfo = {};
-	imageInfo.imageView = m_highResImageView;
-	imageInfo.imageLayout = vk::ImageLayout::eGeneral;
-
-	std::vector<vk::WriteDescriptorSet> writeOps;
-
-	vk::WriteDescriptorSet descriptorWrite = {};
-	descriptorWrite.dstSet = descriptorSet;
-	descriptorWrite.dstBinding = 0;
-	descriptorWrite.dstArrayElement = 0;
-	descriptorWrite.descriptorType = vk::DescriptorType::eStorageImage;
-	descriptorWrite.descriptorCount = 1;
-	descriptorWrite.pImageInfo = &imageInfo;
-	writeOps.push_back(descriptorWrite);
-
-	for (auto& bufferSetup : m_swapchainFrames[0].bufferSetups) {
-		vk::WriteDescriptorSet bufferOp;
-		bufferOp.dstSet = descriptorSet;
-		bufferOp.dstBinding = bufferSetup.dstBinding;
-		bufferOp.dstArrayElement = 0; //byte offset within binding for inline uniform blocks
-		bufferOp.descriptorCount = 1;
-		bufferOp.descriptorType = bufferSetup.descriptorType;
-		bufferOp.pBufferInfo = &bufferSetup.buffer.descriptor;
-		writeOps.push_back(bufferOp);
-	}
-
-	m_device.updateDescriptorSets(writeOps, nullptr);
+	writeHighResDescriptorSet(descriptorSet);
 
 	// Dispatch compute shader
 	dispatchHighResCompute(m_commandPool, m_graphicsQueue, descriptorSet, width, height);
@@ -530,6 +748,75 @@ void Engine::renderHighResImage(Scene* scene, uint32_t width, uint32_t height) {
 	m_device.freeMemory(m_readBackBufferMemory);
 }
 
+void Engine::runCodegenBenchmark(Scene* scene) {
+	// Flat map() against one function per group and against bound culled union groups, on synthetic baked scenes
+	// rendered offscreen at viewport size
+	const uint32_t width = 1280;
+	const uint32_t height = 720;
+	const int frames = 20;
+	const int nodeCounts[] = { 100, 1000, 5000 };
+	struct Layout {
+		const char* name;
+		int groupFunctionMinNodes;
+		bool boundsCulling;
+	};
+	const Layout layouts[] = { { "flat", 0, false }, { "functions", 8, false }, { "culled", 0, true } };
+
+	createHighResImage(width, height);
+	vk::DescriptorPool descPool = createHighResDescriptorPool(scene);
+
+	std::cout << "nodes, layout, GLSL bytes, codegen ms, glslang ms, pipeline ms, ms per frame" << std::endl;
+	for (int nodeCount : nodeCounts) {
+		for (const Layout& layout : layouts) {
+			auto startTime = std::chrono::high_resolution_clock::now();
+			std::string shaderCode = scene->getBenchmarkShaderCode(nodeCount, layout.groupFunctionMinNodes, layout.boundsCulling);
+			auto codegenTime = std::chrono::high_resolution_clock::now();
+
+			// Compiled directly so the SPIR-V cache cannot hide the glslang time
+			std::string source = vkUtil::assembleShaderSource(shaderCode);
+			std::vector<uint32_t> spirv = vkUtil::compileShaderSourceToSpirv(source, "Benchmark", GLSLANG_STAGE_COMPUTE);
+			auto glslangTime = std::chrono::high_resolution_clock::now();
+			if (spirv.empty()) {
+				std::cout << nodeCount << ", " << layout.name << ", compile failed" << std::endl;
+				continue;
+			}
+
+			vk::ShaderModuleCreateInfo moduleInfo = {};
+			moduleInfo.codeSize = spirv.size() * sizeof(uint32_t);
+			moduleInfo.pCode = spirv.data();
+			vk::ShaderModule module = m_device.createShaderModule(moduleInfo);
+			createHgihResComputePipeline(module, scene);
+			auto pipelineTime = std::chrono::high_resolution_clock::now();
+
+			m_device.resetDescriptorPool(descPool);
+			vk::DescriptorSet descriptorSet = vkInit::allocate_descriptor_set(m_device, descPool, m_HighResDescriptorSetLayout);
+			writeHighResDescriptorSet(descriptorSet);
+
+			dispatchHighResCompute(m_commandPool, m_graphicsQueue, descriptorSet, width, height); // warm up
+			auto renderStart = std::chrono::high_resolution_clock::now();
+			for (int i = 0; i < frames; i++) {
+				dispatchHighResCompute(m_commandPool, m_graphicsQueue, descriptorSet, width, height);
+			}
+			auto renderEnd = std::chrono::high_resolution_clock::now();
+
+			auto ms = [](auto from, auto to) { return std::chrono::duration<double, std::milli>(to - from).count(); };
+			std::cout << nodeCount << ", " << layout.name << ", " << shaderCode.size() << ", "
+				<< ms(startTime, codegenTime) << ", " << ms(codegenTime, glslangTime) << ", " << ms(glslangTime, pipelineTime) << ", "
+				<< ms(renderStart, renderEnd) / frames << std::endl;
+
+			m_device.destroyPipeline(m_HighResComputePipeline);
+			m_device.destroyPipelineLayout(m_HighResPipelineLayout);
+			m_device.destroyDescriptorSetLayout(m_HighResDescriptorSetLayout);
+			m_device.destroyShaderModule(module);
+		}
+	}
+
+	m_device.destroyDescriptorPool(descPool);
+	m_device.destroyImageView(m_highResImageView);
+	m_device.destroyImage(m_highResImage);
+	m_device.freeMemory(m_highResImageMemory);
+}
+
 void Engine::init_imgui()
 {
     VkDescriptorPoolSize pool_sizes[] = { { VK_DESCRIPTOR_TYPE_SAMPLER, 1000 },
@@ -640,14 +927,86 @@ void Engine::draw_imgui(vk::CommandBuffer cmd, vk::ImageView targetImageView)
 
 void Engine::prepare_frame(uint32_t imageIndex, Scene* scene) {
 
-	if (scene->needsRecompilation) return;
-
 	vkUtil::SwapChainFrame& frame = m_swapchainFrames[imageIndex];
 
+	// The bound pipeline indexes nodes and BVH roots by the layout it was generated for, keep feeding it
+	// that layout until the pipeline for the edited scene is swapped in
+	NodeData* sceneNodeData = scene->GetNodeDataPtr();
+	if (!scene->needsRecompilation && !m_pipelineOutOfDate) {
+		std::copy(sceneNodeData, sceneNodeData + Scene::m_maxObjects, m_activeNodeData.begin());
+		m_activeBvh = *scene->GetBvhPtr();
+	}
+
+	// The interpreter follows the scene's structure through the bytecode and always gets the current nodes
+	m_useInterpreter = (m_pipelineOutOfDate || m_compileFailed) && !scene->needsRecompilation && m_pipeline[pipelineType::INTERPRETER] && !m_interpreterOutOfDate
+		&& scene->isBytecodeValid();
+
+	// Changes are queued for the grid of every frame and uploaded once that frame comes up
+	std::vector<glm::vec4> changes;
+	bool rebuild = scene->takeSceneGridChanges(changes);
+	for (size_t i = 0; i < m_swapchainFrames.size(); i++) {
+		m_sceneGridPending[i].insert(m_sceneGridPending[i].end(), changes.begin(), changes.end());
+		m_sceneGridRebuild[i] = m_sceneGridRebuild[i] || rebuild || int(m_sceneGridPending[i].size()) > Scene::m_maxSceneGridSpheres;
+	}
+	std::vector<glm::vec4>& pending = m_sceneGridPending[imageIndex];
+	int pendingCount = m_sceneGridRebuild[imageIndex] ? 0 : int(pending.size());
+	m_sceneGridUpdate.header = glm::ivec4(pendingCount, 0, 0, 0);
+	std::copy(pending.begin(), pending.begin() + pendingCount, m_sceneGridUpdate.spheres);
+	pending.clear();
+
+	// The last frame's hits are a hint for this one while only the camera moved
+	if (rebuild || !changes.empty() || m_lastDescription.viewport != scene->description.viewport
+		|| m_historyPipeline != m_pipeline[active_pipeline_type()]) {
+		m_historyFrame = -1;
+	}
+	m_description = scene->description;
+	m_description.prev_camera_position = m_lastDescription.camera_position;
+	m_description.prev_camera_target = m_lastDescription.camera_target;
+	m_description.prev_camera_roll = m_lastDescription.camera_roll;
+	m_description.prev_camera_fov = m_lastDescription.camera_fov;
+	m_description.historyValid = m_historyFrame >= 0 ? 1 : 0;
+	const SceneDescription& last = m_lastDescription;
+	const SceneDescription& next = scene->description;
+	bool idle = m_historyFrame >= 0
+		&& last.camera_position == next.camera_position && last.camera_target == next.camera_target
+		&& last.camera_roll == next.camera_roll && last.camera_fov == next.camera_fov
+		&& last.backgroundColor == next.backgroundColor && last.sunPos == next.sunPos
+		&& last.outlineTickness == next.outlineTickness && last.outlineCol == next.outlineCol && last.showGrid == next.showGrid
+		&& last.lodDistance == next.lodDistance && last.lodFootprint == next.lodFootprint
+		&& std::equal(sceneNodeData, sceneNodeData + Scene::m_maxObjects, m_accumulatedNodeData.begin());
+	if (!idle) {
+		m_accumulatedSamples = 0;
+		std::copy(sceneNodeData, sceneNodeData + Scene::m_maxObjects, m_accumulatedNodeData.begin());
+	}
+	m_description.accumulatedSamples = m_accumulatedSamples;
+	for (vkUtil::FrameImage& frameImage : frame.images) {
+		if (frameImage.previous >= 0) {
+			int source = m_historyFrame >= 0 ? m_historyFrame : int(imageIndex);
+			frameImage.view = m_swapchainFrames[source].images[frameImage.previous].view;
+			frameImage.descriptor.imageView = frameImage.view;
+		}
+	}
+
 	for (auto& bufferSetup : frame.bufferSetups) {
+		void* dataPtr = bufferSetup.dataPtr;
+		if (dataPtr == nullptr) { // written on the GPU
+			continue;
+		}
+		if (dataPtr == &scene->description) {
+			dataPtr = &m_description;
+		}
+		if (dataPtr == scene->GetSceneGridUpdatePtr()) {
+			dataPtr = &m_sceneGridUpdate;
+		}
+		if (dataPtr == sceneNodeData && !m_useInterpreter) {
+			dataPtr = m_activeNodeData.data();
+		}
+		if (dataPtr == scene->GetBvhPtr()) {
+			dataPtr = &m_activeBvh;
+		}
 		m_device.waitForFences(1, &m_mainFence, VK_TRUE, UINT64_MAX);
 		m_device.resetFences(1, &m_mainFence);
-		bufferSetup.buffer.blit((void*)bufferSetup.dataPtr, bufferSetup.dataSize, m_graphicsQueue, m_mainCommandBuffer, m_mainFence);
+		bufferSetup.buffer.blit(dataPtr, bufferSetup.dataSize, m_graphicsQueue, m_mainCommandBuffer, m_mainFence);
 	}
 
 	frame.write_descriptor_set();
@@ -687,46 +1046,521 @@ void Engine::prepare_to_trace_barrier(vk::CommandBuffer commandBuffer, vk::Image
 	commandBuffer.pipelineBarrier(sourceStage, destinationStage, vk::DependencyFlags(), nullptr, nullptr, barrier);
 }
 
+std::string Engine::interpreter_shader_source()
+{
+	std::vector<char> interpreter = vkUtil::LoadShaderResource(IDR_SHADER_SCENE);
+	return m_interpreterShaderCode + std::string(interpreter.begin(), interpreter.end());
+}
+
+void Engine::make_interpreter_pipeline()
+{
+	std::string shaderCode = interpreter_shader_source();
+	m_computePipelineBuilder.specify_compute_shader(shaderCode.c_str());
+	m_computePipelineBuilder.add_descriptor_set_layout(m_frameSetLayout[pipelineType::COMPUTE]);
+	vkInit::ComputePipelineOutBundle output = m_computePipelineBuilder.build();
+	m_computePipelineBuilder.reset();
+
+	if (m_pipeline[pipelineType::INTERPRETER]) {
+		m_retiredPipelines.push_back({ { m_pipelineLayout[pipelineType::INTERPRETER], m_pipeline[pipelineType::INTERPRETER] }, m_maxFramesInFlight + 1 });
+	}
+	m_pipelineLayout[pipelineType::INTERPRETER] = output.layout;
+	m_pipeline[pipelineType::INTERPRETER] = output.pipeline;
+	m_pipelineQuality[pipelineType::INTERPRETER] = output.quality;
+}
+
 void Engine::recompile_shader()
 {
-	if (m_pipelineNumber == 0) {
-		m_computePipelineBuilder.specify_compute_shader(m_scene->getShaderCode().c_str());
-		m_computePipelineBuilder.add_descriptor_set_layout(m_frameSetLayout[pipelineType::COMPUTE]);
+	m_scene->needsRecompilation = false;
+	// The interpreter reads the structure from the bytecode buffer and is only rebuilt for shape code changes
+	std::string interpreterCode = m_scene->getInterpreterShaderCode();
+	if (interpreterCode != m_interpreterShaderCode) {
+		m_interpreterShaderCode = interpreterCode;
+		{
+			std::lock_guard<std::mutex> lock(m_compileMutex);
+			m_requestedInterpreterCode = interpreter_shader_source();
+			m_requestedInterpreterGeneration = ++m_latestInterpreterGeneration;
+			m_interpreterRequested = true;
+		}
+		m_compileCondition.notify_one();
+		m_interpreterOutOfDate = true;
+	}
+	m_scene->updateBytecode();
+	m_scene->updateBvh();
+
+	std::string shaderCode = m_scene->getShaderCode();
+	// Any earlier failure is either retried below or left behind for the code of the bound pipeline
+	m_compileFailed = false;
+	// Value only edits live in the node buffer and produce the same code, nothing to compile
+	if (shaderCode == m_sceneShaderCode) {
+		return;
+	}
+	m_sceneShaderCode = shaderCode;
+
+	{
+		std::lock_guard<std::mutex> lock(m_compileMutex);
+		m_requestedShaderCode = std::move(shaderCode);
+		m_requestedGeneration = ++m_latestGeneration;
+		m_compileRequested = true;
+		// any bake in flight was generated for the old structure
+		++m_latestBakeGeneration;
+		m_bakeRequested = false;
+	}
+	m_compileCondition.notify_one();
+	m_pipelineOutOfDate = true;
+	m_bakedLive.clear();
+}
 
-		vkInit::ComputePipelineOutBundle computeOutputSecond = m_computePipelineBuilder.build();
+void Engine::compile_worker(vk::DescriptorSetLayout descriptorSetLayout)
+{
+	vkInit::ComputePipelineBuilder builder(m_device);
+	builder.set_pipeline_cache(m_pipelineCache);
+	builder.set_creation_feedback(m_creationFeedback);
+	builder.set_workgroup_size(m_workgroupSize);
+	while (true) {
+		std::string shaderCode;
+		uint64_t generation;
+		bool baked = false;
+		bool interpreter = false;
+		int bakeAA = 0;
+		{
+			std::unique_lock<std::mutex> lock(m_compileMutex);
+			m_compileBusy = false;
+			m_compileCondition.wait(lock, [this] { return m_stopCompileThread || m_compileRequested || m_interpreterRequested || m_bakeRequested; });
+			if (m_stopCompileThread) {
+				break;
+			}
+			m_compileBusy = true;
+			// edits go before the interpreter, which goes before bakes
+			if (m_compileRequested) {
+				shaderCode = std::move(m_requestedShaderCode);
+				generation = m_requestedGeneration;
+				m_compileRequested = false;
+			}
+			else if (m_interpreterRequested) {
+				interpreter = true;
+				shaderCode = std::move(m_requestedInterpreterCode);
+				generation = m_requestedInterpreterGeneration;
+				m_interpreterRequested = false;
+			}
+			else {
+				baked = true;
+				shaderCode = std::move(m_requestedBakeCode);
+				generation = m_requestedBakeGeneration;
+				bakeAA = m_requestedBakeAA;
+				m_bakeRequested = false;
+			}
+		}
+		std::atomic<uint64_t>& latestGeneration = baked ? m_latestBakeGeneration : interpreter ? m_latestInterpreterGeneration : m_latestGeneration;
 
-		m_pipelineLayout[pipelineType::COMPUTE2] = computeOutputSecond.layout;
-		m_pipeline[pipelineType::COMPUTE2] = computeOutputSecond.pipeline;
-		m_computePipelineBuilder.reset();
-		m_pipelineNumber = 1;
+		// A newer edit supersedes this one, skip whatever work is left
+		builder.specify_compute_shader(shaderCode.c_str());
+		if (generation != latestGeneration) {
+			builder.reset();
+			continue;
+		}
+		builder.add_descriptor_set_layout(descriptorSetLayout);
+		builder.set_render_quality(vkUtil::get_render_quality(baked ? qualityTier::PREVIEW : qualityTier::INTERACTIVE, bakeAA));
+		vkInit::ComputePipelineOutBundle output = builder.build();
+		builder.reset();
+		if (generation != latestGeneration) {
+			destroy_pipeline(output);
+			continue;
+		}
+
+		std::lock_guard<std::mutex> lock(m_compileMutex);
+		bool& ready = baked ? m_bakedReady : interpreter ? m_interpreterReady : m_compiledReady;
+		vkInit::ComputePipelineOutBundle& compiled = baked ? m_compiledBakedPipeline : interpreter ? m_compiledInterpreterPipeline : m_compiledPipeline;
+		if (ready) {
+			destroy_pipeline(compiled);
+		}
+		compiled = output;
+		(baked ? m_compiledBakedGeneration : interpreter ? m_compiledInterpreterGeneration : m_compiledGeneration) = generation;
+		ready = true;
+	}
+}
+
+bool Engine::isIdle(Scene* scene)
+{
+	// Frames still have work while samples accumulate, pipelines are on their way or retired ones wait to be destroyed
+	if (m_accumulatedSamples < m_maxAccumulatedSamples || m_pipelineOutOfDate || !m_retiredPipelines.empty()
+		|| scene->needsRecompilation || scene->needsFreezeBake) {
+		return false;
+	}
+	// and until the scene has been still long enough to request the baked pipeline
+	if (!m_useBakedPipeline && !m_bakeAttempted) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(m_compileMutex);
+	return !m_compileRequested && !m_interpreterRequested && !m_bakeRequested && !m_compileBusy
+		&& !m_compiledReady && !m_interpreterReady && !m_bakedReady;
+}
+
+void Engine::swap_compiled_pipeline()
+{
+	for (auto it = m_retiredPipelines.begin(); it != m_retiredPipelines.end();) {
+		if (--it->framesLeft <= 0) {
+			destroy_pipeline(it->bundle);
+			it = m_retiredPipelines.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	vkInit::ComputePipelineOutBundle output, bakedOutput, interpreterOutput;
+	uint64_t generation = 0, bakedGeneration = 0, interpreterGeneration = 0;
+	bool compiledReady, bakedReady, interpreterReady;
+	{
+		std::lock_guard<std::mutex> lock(m_compileMutex);
+		compiledReady = m_compiledReady;
+		bakedReady = m_bakedReady;
+		interpreterReady = m_interpreterReady;
+		output = m_compiledPipeline;
+		generation = m_compiledGeneration;
+		bakedOutput = m_compiledBakedPipeline;
+		bakedGeneration = m_compiledBakedGeneration;
+		interpreterOutput = m_compiledInterpreterPipeline;
+		interpreterGeneration = m_compiledInterpreterGeneration;
+		m_compiledReady = false;
+		m_bakedReady = false;
+		m_interpreterReady = false;
+	}
+
+	if (interpreterReady) {
+		if (interpreterOutput.pipeline && interpreterGeneration == m_latestInterpreterGeneration) {
+			if (m_pipeline[pipelineType::INTERPRETER]) {
+				m_retiredPipelines.push_back({ { m_pipelineLayout[pipelineType::INTERPRETER], m_pipeline[pipelineType::INTERPRETER] }, m_maxFramesInFlight + 1 });
+			}
+			m_pipelineLayout[pipelineType::INTERPRETER] = interpreterOutput.layout;
+			m_pipeline[pipelineType::INTERPRETER] = interpreterOutput.pipeline;
+			m_pipelineQuality[pipelineType::INTERPRETER] = interpreterOutput.quality;
+			m_interpreterOutOfDate = false;
+		}
+		else {
+			destroy_pipeline(interpreterOutput);
+		}
 	}
-	else {
-		m_computePipelineBuilder.specify_compute_shader(m_scene->getShaderCode().c_str());
-		m_computePipelineBuilder.add_descriptor_set_layout(m_frameSetLayout[pipelineType::COMPUTE]);
 
-		vkInit::ComputePipelineOutBundle computeOutput = m_computePipelineBuilder.build();
+	if (bakedReady) {
+		if (bakedOutput.pipeline && bakedGeneration == m_latestBakeGeneration) {
+			m_retiredPipelines.push_back({ { m_pipelineLayout[pipelineType::COMPUTE_BAKED], m_pipeline[pipelineType::COMPUTE_BAKED] }, m_maxFramesInFlight + 1 });
+			m_pipelineLayout[pipelineType::COMPUTE_BAKED] = bakedOutput.layout;
+			m_pipeline[pipelineType::COMPUTE_BAKED] = bakedOutput.pipeline;
+			m_pipelineQuality[pipelineType::COMPUTE_BAKED] = bakedOutput.quality;
+			m_bakedNodeData = m_pendingBakeNodeData;
+			m_bakedLive = m_pendingBakeLive;
+			m_bakedAA = m_pendingBakeAA;
+			m_sceneGridRebuild.assign(m_swapchainFrames.size(), true);
+			m_historyFrame = -1;
+		}
+		else {
+			destroy_pipeline(bakedOutput);
+		}
+	}
 
-		m_pipelineLayout[pipelineType::COMPUTE] = computeOutput.layout;
-		m_pipeline[pipelineType::COMPUTE] = computeOutput.pipeline;
+	if (!compiledReady) {
+		return;
+	}
+
+	if (!output.pipeline) {
+		destroy_pipeline(output);
+		if (generation == m_latestGeneration) {
+			vkLogging::Logger::get_logger()->print("Shader compilation failed, keeping the last good pipeline");
+			// Nothing newer is coming, stop waiting for it. The bound code is what the next edit compares against, so it compiles again
+			m_compileFailed = true;
+			m_sceneShaderCode = m_activeShaderCode;
+			m_pipelineOutOfDate = false;
+		}
+		return;
+	}
+
+	// Write into the idle slot of the double buffer, its old pipeline may still be used by frames in flight
+	pipelineType target = (m_pipelineNumber == 0) ? pipelineType::COMPUTE2 : pipelineType::COMPUTE;
+	m_retiredPipelines.push_back({ { m_pipelineLayout[target], m_pipeline[target] }, m_maxFramesInFlight + 1 });
+	m_pipelineLayout[target] = output.layout;
+	m_pipeline[target] = output.pipeline;
+	m_pipelineQuality[target] = output.quality;
+	m_pipelineNumber = (m_pipelineNumber == 0) ? 1 : 0;
+	// a new pipeline can reuse the handle of a destroyed one, so the grids cannot tell by the handle alone
+	m_sceneGridRebuild.assign(m_swapchainFrames.size(), true);
+	m_historyFrame = -1;
+
+	if (generation == m_latestGeneration) {
+		m_pipelineOutOfDate = false;
+		m_activeShaderCode = m_sceneShaderCode;
+	}
+}
+
+void Engine::update_baked_pipeline(Scene* scene)
+{
+	if (scene->needsRecompilation || m_pipelineOutOfDate) {
+		m_useBakedPipeline = false;
+		m_bakeAttempted = false;
+		m_lastSceneChange = SDL_GetTicks();
+		return;
+	}
+
+	NodeData* sceneNodeData = scene->GetNodeDataPtr();
+	int sceneSize = scene->getSceneSize();
+	std::vector<bool> live = scene->getLiveNodes();
+	if (!std::equal(sceneNodeData, sceneNodeData + Scene::m_maxObjects, m_activeNodeData.begin()) || live != m_lastLive || scene->getAA() != m_lastAA) {
+		m_bakeAttempted = false;
+		m_lastSceneChange = SDL_GetTicks();
+		m_lastLive = live;
+		m_lastAA = scene->getAA();
+	}
+
+	// The baked pipeline stays usable while only live nodes change, its AA is a specialization constant
+	m_useBakedPipeline = m_pipeline[pipelineType::COMPUTE_BAKED] && live == m_bakedLive && scene->getAA() == m_bakedAA;
+	for (int i = 0; i < sceneSize && m_useBakedPipeline; i++) {
+		m_useBakedPipeline = live[i] || sceneNodeData[i] == m_bakedNodeData[i];
+	}
+
+	if (m_useBakedPipeline || m_bakeAttempted || SDL_GetTicks() - m_lastSceneChange < m_bakeIdleDelay) {
+		return;
+	}
+
+	std::copy(sceneNodeData, sceneNodeData + Scene::m_maxObjects, m_pendingBakeNodeData.begin());
+	m_pendingBakeLive = live;
+	m_pendingBakeAA = scene->getAA();
+	m_bakeAttempted = true;
+	std::string shaderCode = scene->getShaderCode(codegenMode::BAKED);
+	{
+		std::lock_guard<std::mutex> lock(m_compileMutex);
+		m_requestedBakeCode = std::move(shaderCode);
+		m_requestedBakeAA = m_pendingBakeAA;
+		m_requestedBakeGeneration = ++m_latestBakeGeneration;
+		m_bakeRequested = true;
+	}
+	m_compileCondition.notify_one();
+}
+
+void Engine::bake_frozen_volumes(Scene* scene)
+{
+	scene->needsFreezeBake = false;
+	if (scene->getFrozenVolumeCount() == 0) {
+		return;
+	}
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	// One pipeline per frozen group, each evaluates the group's own map() once per brick sample
+	std::vector<vkInit::ComputePipelineOutBundle> bakePipelines;
+	for (int v = 0; v < scene->getFrozenVolumeCount(); v++) {
+		std::string shaderCode = scene->getFreezeShaderCode(v);
+		m_computePipelineBuilder.specify_compute_shader(shaderCode.c_str(), IDR_SHADER_FREEZE);
+		m_computePipelineBuilder.add_descriptor_set_layout(m_frameSetLayout[pipelineType::COMPUTE]);
+		bakePipelines.push_back(m_computePipelineBuilder.build());
 		m_computePipelineBuilder.reset();
-		m_pipelineNumber = 0;
 	}
-	m_scene->needsRecompilation = false;
+
+	// Every frame owns a pool, so all of them are emptied and baked while no frame is in flight
+	m_device.waitIdle();
+	for (vkUtil::SwapChainFrame& frame : m_swapchainFrames) {
+		frame.write_descriptor_set();
+	}
+	immediate_submit([&](vk::CommandBuffer cmd) {
+		for (vkUtil::SwapChainFrame& frame : m_swapchainFrames) {
+			cmd.fillBuffer(frame.bufferSetups[scene->getFrozenPoolBuffer()].buffer.buffer, 0, sizeof(glm::ivec4), 0);
+		}
+		vk::MemoryBarrier clearBarrier = {};
+		clearBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		clearBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), clearBarrier, nullptr, nullptr);
+
+		for (auto& bundle : bakePipelines) {
+			cmd.bindPipeline(vk::PipelineBindPoint::eCompute, bundle.pipeline);
+			for (vkUtil::SwapChainFrame& frame : m_swapchainFrames) {
+				cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, bundle.layout, 0, frame.descriptorSet[pipelineType::COMPUTE], nullptr);
+				cmd.dispatch(Scene::m_frozenBricks, Scene::m_frozenBricks, Scene::m_frozenBricks);
+			}
+		}
+
+		vk::MemoryBarrier bakeBarrier = {};
+		bakeBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+		bakeBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferRead;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer,
+			vk::DependencyFlags(), bakeBarrier, nullptr, nullptr);
+
+		// The header counts every brick that asked for a slot, every frame baked the same ones
+		Buffer& pool = m_swapchainFrames[0].bufferSetups[scene->getFrozenPoolBuffer()].buffer;
+		cmd.copyBuffer(pool.buffer, pool.stagingBuffer, vk::BufferCopy(0, 0, sizeof(glm::ivec4)));
+		vk::MemoryBarrier readBarrier = {};
+		readBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		readBarrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, vk::DependencyFlags(), readBarrier, nullptr, nullptr);
+	});
+	int usedBricks = static_cast<const int*>(m_swapchainFrames[0].bufferSetups[scene->getFrozenPoolBuffer()].buffer.getWriteLocation())[0];
+
+	for (auto& bundle : bakePipelines) {
+		destroy_pipeline(bundle);
+	}
+	m_sceneGridRebuild.assign(m_swapchainFrames.size(), true);
+	m_historyFrame = -1;
+
+	std::stringstream message;
+	message << "Baked " << scene->getFrozenVolumeCount() << " frozen groups into " << std::min(usedBricks, int(Scene::m_maxFrozenBricks))
+		<< " of " << Scene::m_maxFrozenBricks << " bricks in "
+		<< std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count() << " ms";
+	vkLogging::Logger::get_logger()->print(message.str());
+	// Bricks past the pool only keep their coarse distance, so the surface in them is lost
+	if (usedBricks > Scene::m_maxFrozenBricks) {
+		std::stringstream overflow;
+		overflow << "Frozen brick pool overflowed by " << usedBricks - Scene::m_maxFrozenBricks
+			<< " bricks, parts of the frozen groups are drawn coarse. Unfreeze some groups.";
+		vkLogging::Logger::get_logger()->print(overflow.str());
+		setPopupText(overflow.str(), popupStates::PWARNING);
+	}
 }
 
-void Engine::dispatch_compute(vk::CommandBuffer commandBuffer, uint32_t imageIndex, glm::vec4 viewport) {
+void Engine::destroy_pipeline(vkInit::ComputePipelineOutBundle& bundle)
+{
+	if (bundle.pipeline) {
+		m_device.destroyPipeline(bundle.pipeline);
+		bundle.pipeline = nullptr;
+	}
+	if (bundle.layout) {
+		m_device.destroyPipelineLayout(bundle.layout);
+		bundle.layout = nullptr;
+	}
+}
 
-	if (m_pipelineNumber == 0) {
-		commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_pipeline[pipelineType::COMPUTE]);
-		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_pipelineLayout[pipelineType::COMPUTE], 0, m_swapchainFrames[imageIndex].descriptorSet[pipelineType::COMPUTE], nullptr);
+void Engine::read_pass_times()
+{
+	// The frame that last used this slot has finished, its timestamps are there unless it was not timed
+	if (!m_passQueries || !m_passQueriesWritten[m_frameNumber]) {
+		return;
 	}
-	else {
-		commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_pipeline[pipelineType::COMPUTE2]);
-		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_pipelineLayout[pipelineType::COMPUTE2], 0, m_swapchainFrames[imageIndex].descriptorSet[pipelineType::COMPUTE], nullptr);
+	uint64_t timestamps[m_passQueryCount] = {};
+	vk::Result result = m_device.getQueryPoolResults(m_passQueries, static_cast<uint32_t>(m_frameNumber) * m_passQueryCount, m_passQueryCount,
+		sizeof(timestamps), timestamps, sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+	if (result != vk::Result::eSuccess) {
+		return;
 	}
+	auto ms = [&](int from, int to) { return float(double(timestamps[to] - timestamps[from]) * m_timestampPeriod / 1000000.0); };
+	m_passTimes = glm::vec4(ms(0, 1), ms(1, 2), ms(2, 3), ms(3, 4));
+}
 
+pipelineType Engine::active_pipeline_type()
+{
+	if (m_useInterpreter) {
+		return pipelineType::INTERPRETER;
+	}
+	if (m_useBakedPipeline) {
+		return pipelineType::COMPUTE_BAKED;
+	}
+	return (m_pipelineNumber == 0) ? pipelineType::COMPUTE : pipelineType::COMPUTE2;
+}
+
+void Engine::dispatch_compute(vk::CommandBuffer commandBuffer, uint32_t imageIndex, glm::vec4 viewport, bool timed) {
+
+	// Timestamps after the grid and cone passes, the render pass, the lighting pass and the shading pass, in this frame's slot
+	uint32_t firstQuery = static_cast<uint32_t>(m_frameNumber) * m_passQueryCount;
+	auto stamp = [&](uint32_t query) {
+		if (timed) {
+			commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, m_passQueries, firstQuery + query);
+		}
+	};
+	if (timed) {
+		commandBuffer.resetQueryPool(m_passQueries, firstQuery, m_passQueryCount);
+	}
 
-	commandBuffer.dispatch(static_cast<uint32_t>((viewport.z + 7) / 8), static_cast<uint32_t>((viewport.w + 7) / 8), 1);
+	pipelineType type = active_pipeline_type();
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_pipeline[type]);
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_pipelineLayout[type], 0, m_swapchainFrames[imageIndex].descriptorSet[pipelineType::COMPUTE], nullptr);
+
+	// The history of the frame drawn before is read here, and this frame's is still read by the one before it
+	vk::MemoryBarrier historyBarrier = {};
+	historyBarrier.srcAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+	historyBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), historyBarrier, nullptr, nullptr);
+	stamp(0);
+
+	// The grid follows the map() of the pipeline that filled it, any other pipeline starts over
+	if (m_sceneGridPipeline[imageIndex] != m_pipeline[type]) {
+		m_sceneGridRebuild[imageIndex] = true;
+	}
+	vkUtil::PassConstants pass = { int32_t(passMode::SCENE_GRID), m_sceneGridRebuild[imageIndex] ? VK_TRUE : VK_FALSE };
+	if (pass.rebuild || m_sceneGridUpdate.header.x > 0) {
+		commandBuffer.pushConstants(m_pipelineLayout[type], vk::ShaderStageFlagBits::eCompute, 0, sizeof(pass), &pass);
+		commandBuffer.dispatch((Scene::m_sceneGridSize + m_workgroupSize.x - 1) / m_workgroupSize.x, (Scene::m_sceneGridSize + m_workgroupSize.y - 1) / m_workgroupSize.y, Scene::m_sceneGridSize);
+		vk::MemoryBarrier gridBarrier = {};
+		gridBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+		gridBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), gridBarrier, nullptr, nullptr);
+		m_sceneGridRebuild[imageIndex] = false;
+		m_sceneGridPipeline[imageIndex] = m_pipeline[type];
+	}
+
+	// One cone per tile of the viewport finds how far its rays can start, with the same map() they march,
+	// and sorts the tile into the list of its class. The lists start empty, each with a dispatch of 0x1x1.
+	uint32_t tilesX = (static_cast<uint32_t>(viewport.z) + m_coneTile - 1) / m_coneTile;
+	uint32_t tilesY = (static_cast<uint32_t>(viewport.w) + m_coneTile - 1) / m_coneTile;
+	bool tiled = tilesX * tilesY <= Scene::m_maxTiles;
+	vk::Buffer tileBuffer = m_swapchainFrames[imageIndex].bufferSetups[m_scene->getTileBuffer()].buffer.buffer;
+	if (tiled) {
+		glm::uvec4 dispatches[3] = { glm::uvec4(0, 1, 1, 0), glm::uvec4(0, 1, 1, 0), glm::uvec4(0, 1, 1, 0) };
+		vk::MemoryBarrier clearBarrier = {};
+		clearBarrier.srcAccessMask = vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eShaderRead;
+		clearBarrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), clearBarrier, nullptr, nullptr);
+		commandBuffer.updateBuffer(tileBuffer, 0, sizeof(dispatches), dispatches);
+		clearBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		clearBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), clearBarrier, nullptr, nullptr);
+	}
+	pass = { int32_t(passMode::CONE), tiled ? VK_TRUE : VK_FALSE };
+	commandBuffer.pushConstants(m_pipelineLayout[type], vk::ShaderStageFlagBits::eCompute, 0, sizeof(pass), &pass);
+	commandBuffer.dispatch((tilesX + m_workgroupSize.x - 1) / m_workgroupSize.x, (tilesY + m_workgroupSize.y - 1) / m_workgroupSize.y, 1);
+	vk::MemoryBarrier coneBarrier = {};
+	coneBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+	coneBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eIndirectCommandRead;
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eDrawIndirect, vk::DependencyFlags(), coneBarrier, nullptr, nullptr);
+	stamp(1);
+
+	// Every class of tiles is drawn with its own budget, only as many workgroups as its tiles need
+	uint32_t groupsX = (static_cast<uint32_t>(viewport.z) + m_workgroupSize.x - 1) / m_workgroupSize.x;
+	uint32_t groupsY = (static_cast<uint32_t>(viewport.w) + m_workgroupSize.y - 1) / m_workgroupSize.y;
+	if (tiled) {
+		for (tileClass tiles : { tileClass::EMPTY, tileClass::SIMPLE, tileClass::COMPLEX }) {
+			pass = { int32_t(passMode::RENDER), VK_FALSE, int32_t(tiles) };
+			commandBuffer.pushConstants(m_pipelineLayout[type], vk::ShaderStageFlagBits::eCompute, 0, sizeof(pass), &pass);
+			commandBuffer.dispatchIndirect(tileBuffer, (int(tiles) - int(tileClass::EMPTY)) * sizeof(glm::uvec4));
+		}
+	}
+	else {
+		pass = { int32_t(passMode::RENDER), VK_FALSE, int32_t(tileClass::ALL) };
+		commandBuffer.pushConstants(m_pipelineLayout[type], vk::ShaderStageFlagBits::eCompute, 0, sizeof(pass), &pass);
+		commandBuffer.dispatch(groupsX, groupsY, 1);
+	}
+
+	// With split shading the render pass only left its hits in the G-buffer, every pixel is lit from there.
+	// Pipelines without it have drawn the frame already and return at once.
+	vk::MemoryBarrier gBufferBarrier = {};
+	gBufferBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+	gBufferBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), gBufferBarrier, nullptr, nullptr);
+	stamp(2);
+
+	// Tiers with a lighting scale compute AO and sun shadow for one pixel of every square of that size first,
+	// the shading pass upsamples them to the pixels that saw the same surface
+	const vkUtil::RenderQuality& quality = m_pipelineQuality[type];
+	if (quality.splitShading && quality.accumulate && quality.lightingScale > 1) {
+		uint32_t scale = static_cast<uint32_t>(quality.lightingScale);
+		uint32_t blocksX = (static_cast<uint32_t>(viewport.z) + scale - 1) / scale;
+		uint32_t blocksY = (static_cast<uint32_t>(viewport.w) + scale - 1) / scale;
+		pass = { int32_t(passMode::LIGHTING), VK_FALSE, int32_t(tileClass::ALL) };
+		commandBuffer.pushConstants(m_pipelineLayout[type], vk::ShaderStageFlagBits::eCompute, 0, sizeof(pass), &pass);
+		commandBuffer.dispatch((blocksX + m_workgroupSize.x - 1) / m_workgroupSize.x, (blocksY + m_workgroupSize.y - 1) / m_workgroupSize.y, 1);
+		vk::MemoryBarrier lightingBarrier = {};
+		lightingBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+		lightingBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), lightingBarrier, nullptr, nullptr);
+	}
+	stamp(3);
+	pass = { int32_t(passMode::SHADE), VK_FALSE, int32_t(tileClass::ALL) };
+	commandBuffer.pushConstants(m_pipelineLayout[type], vk::ShaderStageFlagBits::eCompute, 0, sizeof(pass), &pass);
+	commandBuffer.dispatch(groupsX, groupsY, 1);
+	stamp(4);
 
 }
 
@@ -761,6 +1595,7 @@ void Engine::prepare_to_present_barrier(vk::CommandBuffer commandBuffer, vk::Ima
 void Engine::render(Scene* scene) {
 	m_device.waitForFences(1, &(m_swapchainFrames[m_frameNumber].inFlight), VK_TRUE, UINT64_MAX);
 	m_device.resetFences(1, &(m_swapchainFrames[m_frameNumber].inFlight));
+	read_pass_times();
 
 	uint32_t imageIndex; 
 	try {
@@ -784,6 +1619,11 @@ void Engine::render(Scene* scene) {
 		std::cout << "Failed to acquire swapchain image!" << std::endl;
 	}
 
+	if (scene->needsFreezeBake) {
+		bake_frozen_volumes(scene);
+	}
+	swap_compiled_pipeline();
+	update_baked_pipeline(scene);
 	prepare_frame(imageIndex, scene);
 
 	vk::CommandBuffer commandBuffer = m_swapchainFrames[m_frameNumber].commandBuffer;
@@ -796,7 +1636,9 @@ void Engine::render(Scene* scene) {
 		vkLogging::Logger::get_logger()->print("Failed to begin recording command buffer!");
 	}
 	prepare_to_trace_barrier(commandBuffer, m_swapchainFrames[imageIndex].image);
-	dispatch_compute(commandBuffer, imageIndex, scene->m_viewport);
+	bool timed = static_cast<bool>(m_passQueries);
+	dispatch_compute(commandBuffer, imageIndex, scene->m_viewport, timed);
+	m_passQueriesWritten[m_frameNumber] = timed;
 	vk::ImageMemoryBarrier barrierToRendering = {};
 	barrierToRendering.oldLayout = vk::ImageLayout::eGeneral;
 	barrierToRendering.newLayout = vk::ImageLayout::eColorAttachmentOptimal;
@@ -856,6 +1698,10 @@ void Engine::render(Scene* scene) {
 	submitInfo.pSignalSemaphores = signalSemaphores;
 	try {
 		m_graphicsQueue.submit(submitInfo, m_swapchainFrames[m_frameNumber].inFlight);
+		m_historyFrame = int(imageIndex);
+		m_historyPipeline = m_pipeline[active_pipeline_type()];
+		m_lastDescription = m_description;
+		m_accumulatedSamples = std::min(m_accumulatedSamples + 1, m_maxAccumulatedSamples);
 	}
 	catch (vk::SystemError err) {
 		vkLogging::Logger::get_logger()->print("failed to submit draw command buffer!");
@@ -937,6 +1783,10 @@ void Engine::cleanup_swapchain() {
 	m_device.destroySwapchainKHR(m_swapchain);
 
 	m_device.destroyDescriptorPool(m_frameDescriptorPool[pipelineType::COMPUTE]);
+	if (m_passQueries) {
+		m_device.destroyQueryPool(m_passQueries);
+		m_passQueries = nullptr;
+	}
 
 }
 
@@ -953,9 +1803,45 @@ std::vector<char> Engine::LoadEmbeddedFontResource(int resourceID) {
 }
 
 Engine::~Engine() {
+	{
+		std::lock_guard<std::mutex> lock(m_compileMutex);
+		m_stopCompileThread = true;
+	}
+	m_compileCondition.notify_one();
+	if (m_compileThread.joinable()) {
+		m_compileThread.join();
+	}
+
+	std::stringstream cacheMessage;
+	cacheMessage << "SPIR-V cache hits: " << vkUtil::SpirvCache::get_cache()->get_hits()
+		<< ", misses: " << vkUtil::SpirvCache::get_cache()->get_misses();
+	vkLogging::Logger::get_logger()->print(cacheMessage.str());
+
 	glslang::FinalizeProcess();
 	m_device.waitIdle();
 
+	if (m_compiledReady) {
+		destroy_pipeline(m_compiledPipeline);
+	}
+	if (m_bakedReady) {
+		destroy_pipeline(m_compiledBakedPipeline);
+	}
+	if (m_interpreterReady) {
+		destroy_pipeline(m_compiledInterpreterPipeline);
+	}
+	m_device.destroyPipeline(m_pipeline[pipelineType::COMPUTE_BAKED]);
+	m_device.destroyPipelineLayout(m_pipelineLayout[pipelineType::COMPUTE_BAKED]);
+	m_device.destroyPipeline(m_pipeline[pipelineType::INTERPRETER]);
+	m_device.destroyPipelineLayout(m_pipelineLayout[pipelineType::INTERPRETER]);
+	for (RetiredPipeline& retired : m_retiredPipelines) {
+		destroy_pipeline(retired.bundle);
+	}
+	m_device.destroyPipeline(m_pipeline[pipelineType::COMPUTE2]);
+	m_device.destroyPipelineLayout(m_pipelineLayout[pipelineType::COMPUTE2]);
+
+	vkInit::save_pipeline_cache(m_device, m_physicalDevice, m_pipelineCache, m_pipelineCachePath);
+	m_device.destroyPipelineCache(m_pipelineCache);
+
 	vkLogging::Logger::get_logger()->print("Goodbye see you!");
 
     ImGui_ImplVulkan_Shutdown();
@@ -4,6 +4,12 @@
 #include "scene.h"
 #include "vulkan/vkJob/job.h"
 #include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <limits>
 #define IMGUI_ENABLE_DOCKING
 #include "imgui.h"
 #include "imgui_impl_sdl2.h"
@@ -26,6 +32,21 @@ public:
 
 	void recompile_shader();
 	void renderHighResImage(Scene* scene, uint32_t width, uint32_t height);
+	void runCodegenBenchmark(Scene* scene);
+
+	/**
+		\returns whether drawing another frame of an unchanged scene would show the same image and
+		leave the engine in the same state, so the window can stop drawing until something changes
+	*/
+	bool isIdle(Scene* scene);
+
+	/**
+		\returns GPU milliseconds of the last timed frame spent in the scene grid and cone passes,
+		the render pass, the reduced rate lighting pass and the shading pass
+	*/
+	glm::vec4 getPassTimes() {
+		return m_passTimes;
+	}
 
 	bool isPopupVisible() {
 		return showPopup;
@@ -50,6 +71,7 @@ private:
 	SDL_Window* m_window;
 	int m_pipelineNumber = 0;
 	std::string m_sceneShaderCode;
+	std::string m_activeShaderCode; // code of the bound pipeline, restored as m_sceneShaderCode when a newer one fails
 
 	bool showPopup = false;
 	std::string popupText = "";
@@ -76,6 +98,102 @@ private:
 	std::vector<pipelineType> m_pipelineTypes =  {pipelineType::COMPUTE} ;
 	std::unordered_map<pipelineType, vk::PipelineLayout> m_pipelineLayout;
 	std::unordered_map<pipelineType, vk::Pipeline> m_pipeline;
+	std::unordered_map<pipelineType, vkUtil::RenderQuality> m_pipelineQuality; // decides the passes dispatch_compute records
+	vk::PipelineCache m_pipelineCache{ nullptr };
+	std::string m_pipelineCachePath;
+	bool m_creationFeedback = false; // Vulkan 1.3 or VK_EXT_pipeline_creation_feedback
+	// Workgroup shape of every compute pipeline, timed on the startup scene once per device and saved
+	glm::uvec2 m_workgroupSize = glm::uvec2(8, 8);
+	std::string m_workgroupSizePath;
+	std::vector<glm::uvec2> m_workgroupCandidates = { { 8, 8 }, { 16, 8 }, { 32, 4 }, { 8, 4 }, { 16, 4 } };
+	static const int m_tuningRuns = 4; // timed dispatches per candidate, after one that warms up
+
+	// background shader compilation
+	struct RetiredPipeline {
+		vkInit::ComputePipelineOutBundle bundle;
+		int framesLeft;
+	};
+	std::thread m_compileThread;
+	std::mutex m_compileMutex;
+	std::condition_variable m_compileCondition;
+	bool m_stopCompileThread = false;
+	bool m_compileRequested = false;
+	bool m_compileBusy = false; // the worker is building a request it has taken
+	std::string m_requestedShaderCode;
+	uint64_t m_requestedGeneration = 0;
+	std::atomic<uint64_t> m_latestGeneration{ 0 };
+	bool m_compiledReady = false;
+	vkInit::ComputePipelineOutBundle m_compiledPipeline;
+	uint64_t m_compiledGeneration = 0;
+	// baked (literal) variant of the scene, built once the scene has been idle for a while
+	bool m_bakeRequested = false;
+	std::string m_requestedBakeCode;
+	int m_requestedBakeAA = 0;
+	uint64_t m_requestedBakeGeneration = 0;
+	std::atomic<uint64_t> m_latestBakeGeneration{ 0 };
+	bool m_bakedReady = false;
+	vkInit::ComputePipelineOutBundle m_compiledBakedPipeline;
+	uint64_t m_compiledBakedGeneration = 0;
+	// interpreter for changed shape code, the one in use is skipped until the new one is swapped in
+	bool m_interpreterRequested = false;
+	std::string m_requestedInterpreterCode;
+	uint64_t m_requestedInterpreterGeneration = 0;
+	std::atomic<uint64_t> m_latestInterpreterGeneration{ 0 };
+	bool m_interpreterReady = false;
+	vkInit::ComputePipelineOutBundle m_compiledInterpreterPipeline;
+	uint64_t m_compiledInterpreterGeneration = 0;
+	bool m_interpreterOutOfDate = false;
+	std::vector<RetiredPipeline> m_retiredPipelines;
+	// node data matching the bound pipeline, uploaded instead of the scene's while a newer pipeline is compiling
+	bool m_pipelineOutOfDate = false;
+	bool m_compileFailed = false; // the latest edit did not compile, the interpreter stands in for it if it can
+	std::array<NodeData, Scene::m_maxObjects> m_activeNodeData;
+	Scene::Bvh m_activeBvh = {}; // hierarchy matching m_activeNodeData
+
+	// Every frame has its own scene grid: the changes it has not seen yet and the pipeline that last filled it
+	std::vector<std::vector<glm::vec4>> m_sceneGridPending;
+	std::vector<bool> m_sceneGridRebuild;
+	std::vector<vk::Pipeline> m_sceneGridPipeline;
+	Scene::SceneGridUpdate m_sceneGridUpdate = {};
+	// Storage images of every frame, bound after the scene buffers in this order
+	static const uint32_t m_coneTile = 8; // viewport pixels per side of a cone pass tile
+	std::vector<vkUtil::FrameImageParams> m_frameImages = {
+		{ vk::Format::eR32Sfloat, m_coneTile }, // cone pass depth
+		{ vk::Format::eR32G32Sfloat, 1 }, // hit distance along the pixel center ray and id
+		{ vk::Format::eR32G32Sfloat, 1, 1 }, // the same, of the frame drawn before
+		{ vk::Format::eR32G32B32A32Sfloat, 1 }, // sum of the samples accumulated so far, their count in alpha
+		{ vk::Format::eR32G32B32A32Sfloat, 1, 3 }, // the same, of the frame drawn before
+		{ vk::Format::eR32Uint, m_coneTile }, // most steps a ray of the tile took
+		{ vk::Format::eR32Uint, m_coneTile, 5 }, // the same, of the frame drawn before
+		{ vk::Format::eR32G32B32A32Uint, 1 }, // hit the render pass leaves to the shading pass
+		{ vk::Format::eR32G32B32A32Uint, 2 } // AO and sun shadow at a reduced rate, 2 is the smallest scale
+	};
+	// Reprojection: the frame drawn last and the description it was drawn with, -1 when its history
+	// does not show the current scene
+	int m_historyFrame = -1;
+	vk::Pipeline m_historyPipeline{ nullptr };
+	SceneDescription m_description = {};
+	SceneDescription m_lastDescription = {};
+	// Progressive accumulation: samples summed by the frame drawn last, restarted by any change to what it shows
+	static const int m_maxAccumulatedSamples = 64; // as many as 8x8 AA
+	int m_accumulatedSamples = 0;
+	std::array<NodeData, Scene::m_maxObjects> m_accumulatedNodeData;
+	// bytecode interpreter drawn while the compiled pipeline for an edit is still being built
+	bool m_useInterpreter = false;
+	std::string m_interpreterShaderCode;
+	// node values, live flags and AA the baked (preview tier) pipeline was generated from
+	bool m_useBakedPipeline = false;
+	bool m_bakeAttempted = false;
+	uint32_t m_lastSceneChange = 0;
+	static const uint32_t m_bakeIdleDelay = 500;
+	std::array<NodeData, Scene::m_maxObjects> m_bakedNodeData;
+	std::array<NodeData, Scene::m_maxObjects> m_pendingBakeNodeData;
+	std::vector<bool> m_bakedLive;
+	std::vector<bool> m_pendingBakeLive;
+	std::vector<bool> m_lastLive;
+	int m_bakedAA = 0;
+	int m_pendingBakeAA = 0;
+	int m_lastAA = 0;
 
 	//descriptor-related variables
 	std::unordered_map<pipelineType, vk::DescriptorSetLayout> m_frameSetLayout;
@@ -88,6 +206,13 @@ private:
 
 	//Synchronization objects
 	int m_maxFramesInFlight, m_frameNumber;
+
+	// GPU timestamps of the viewport passes, m_passQueryCount per frame in flight
+	static const uint32_t m_passQueryCount = 5;
+	vk::QueryPool m_passQueries{ nullptr };
+	std::vector<bool> m_passQueriesWritten;
+	float m_timestampPeriod = 1.0f; // nanoseconds per tick
+	glm::vec4 m_passTimes = glm::vec4(0.0f);
     
     // immidiate submit structs
     vk::Fence m_immFence;
@@ -123,6 +248,14 @@ private:
 	//pipeline setup
 	void make_descriptor_set_layouts(Scene* scene);
 	void make_pipelines();
+	void tune_workgroup_size(Scene* scene);
+	void compile_worker(vk::DescriptorSetLayout descriptorSetLayout);
+	void swap_compiled_pipeline();
+	void make_interpreter_pipeline();
+	std::string interpreter_shader_source();
+	void update_baked_pipeline(Scene* scene);
+	void bake_frozen_volumes(Scene* scene);
+	void destroy_pipeline(vkInit::ComputePipelineOutBundle& bundle);
 
 	//final setup steps
 	void finalize_setup(Scene* scene);
@@ -135,6 +268,8 @@ private:
 	void createHighResImage(uint32_t width, uint32_t height);
 	void createHgihResComputePipeline(vk::ShaderModule computeShaderModule, Scene* scene);
 	vk::CommandBuffer allocateHighResCommandBuffer(vk::CommandPool commandPool);
+	vk::DescriptorPool createHighResDescriptorPool(Scene* scene);
+	void writeHighResDescriptorSet(vk::DescriptorSet descriptorSet);
 	void dispatchHighResCompute(vk::CommandPool commandPool, vk::Queue computeQueue, vk::DescriptorSet descriptorSet, uint32_t width, uint32_t height);
 	void createReadBackBuffer(vk::DeviceSize size);
 	void readBackHighResImage(vk::CommandPool commandPool, vk::Queue graphicsQueue, vk::Buffer readBackBuffer, uint32_t width, uint32_t height);
@@ -143,7 +278,9 @@ private:
 	void prepare_frame(uint32_t imageIndex, Scene* scene);
 	void prepare_scene(vk::CommandBuffer commandBuffer);
 	void prepare_to_trace_barrier(vk::CommandBuffer commandBuffer, vk::Image image);
-	void dispatch_compute(vk::CommandBuffer commandBuffer, uint32_t imageIndex, glm::vec4 viewport);
+	pipelineType active_pipeline_type();
+	void dispatch_compute(vk::CommandBuffer commandBuffer, uint32_t imageIndex, glm::vec4 viewport, bool timed);
+	void read_pass_times();
 	void prepare_to_present_barrier(vk::CommandBuffer commandBuffer, vk::Image image);
     
     vk::RenderingAttachmentInfoKHR attachment_info(
@@ -1,7 +1,10 @@
 #include "scene.h"
+#include "logging.h"
 #include <algorithm>
 #include <functional>
 #include <queue>
+#include <iomanip>
+#include <limits>
 #include "cereal/archives/binary.hpp"
 #include <cereal/types/array.hpp>
 
@@ -25,6 +28,8 @@ Scene::Scene(glm::vec4 viewport) : m_sceneGraph(0, false, nullptr, "Scene")
     description.outlineCol = m_outlineColor;
     description.showGrid = m_showGrid;
     description.AA = m_AA;
+    description.lodDistance = m_lodDistance;
+    description.lodFootprint = m_lodFootprint;
 
     InitShapes();
 
@@ -33,12 +38,21 @@ Scene::Scene(glm::vec4 viewport) : m_sceneGraph(0, false, nullptr, "Scene")
     AddBuffer(4, vk::BufferUsageFlagBits::eUniformBuffer, vk::DescriptorType::eUniformBuffer, &frameCount);
     SetupObjects();
     updateNodeData();
-    AddBuffer(sizeof(NodeData) * m_maxObjects, vk::BufferUsageFlagBits::eUniformBuffer, vk::DescriptorType::eUniformBuffer, m_nodeData.data());
+    AddBuffer(sizeof(NodeData) * m_maxObjects, vk::BufferUsageFlagBits::eStorageBuffer, vk::DescriptorType::eStorageBuffer, m_nodeData.data());
+    AddBuffer(sizeof(Bytecode), vk::BufferUsageFlagBits::eStorageBuffer, vk::DescriptorType::eStorageBuffer, &m_bytecode);
+    AddBuffer(sizeof(Bvh), vk::BufferUsageFlagBits::eStorageBuffer, vk::DescriptorType::eStorageBuffer, &m_bvh);
+    // filled on the GPU only, so they have no host copy to upload
+    m_frozenPoolBuffer = int(buffers.size());
+    AddBuffer(sizeof(FrozenPool), vk::BufferUsageFlagBits::eStorageBuffer, vk::DescriptorType::eStorageBuffer, nullptr);
+    AddBuffer(sizeof(float) * m_sceneGridSize * m_sceneGridSize * m_sceneGridSize, vk::BufferUsageFlagBits::eStorageBuffer, vk::DescriptorType::eStorageBuffer, nullptr);
+    AddBuffer(sizeof(SceneGridUpdate), vk::BufferUsageFlagBits::eStorageBuffer, vk::DescriptorType::eStorageBuffer, &m_sceneGridUpdate);
+    m_tileBuffer = int(buffers.size());
+    AddBuffer(sizeof(TileLists), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, vk::DescriptorType::eStorageBuffer, nullptr);
     // add buffer int with selected ID
     AddBuffer(4, vk::BufferUsageFlagBits::eStorageBuffer, vk::DescriptorType::eStorageBuffer, &m_selectedObjectId, true);
 }
 
-void Scene::AddBuffer(size_t size, vk::BufferUsageFlagBits usage, vk::DescriptorType descriptorType, void *dataPtr, bool hostVisible) {
+void Scene::AddBuffer(size_t size, vk::BufferUsageFlags usage, vk::DescriptorType descriptorType, void *dataPtr, bool hostVisible) {
     buffers.push_back({
         size, usage, descriptorType, dataPtr, hostVisible
     });
@@ -131,10 +145,31 @@ float sdTorus( vec3 p, float ri, float ro )
 	return length(t)-ro;
 }
 )", Type::Torus);
+
+    for (auto& shapes : m_shapes) {
+        for (auto& shape : shapes.second) {
+            m_builtinShapeCode[shape.name] = shape.code;
+        }
+    }
+    updateLibraryShapes();
 }
 
 void Scene::AddShape(std::string name, std::string code, Type type) {
     m_shapes[type].push_back(ShaderShape(name, code));
+    updateLibraryShapes();
+}
+
+void Scene::updateLibraryShapes() {
+    // Bounds and normals ask for every node every update, so the comparison is only done when the code changes
+    m_libraryShapes.clear();
+    for (auto& shapes : m_shapes) {
+        for (auto& shape : shapes.second) {
+            auto builtin = m_builtinShapeCode.find(shape.name);
+            if (builtin != m_builtinShapeCode.end() && builtin->second == shape.code) {
+                m_libraryShapes.insert({ shapes.first, shape.name });
+            }
+        }
+    }
 }
 
 float Scene::getShapeIdByName(std::string name, Type type) {
@@ -338,6 +373,12 @@ void Scene::RecreateScene(SceneData* data) {
     m_sceneGraph.setId(0);
 	m_sceneGraphNodes.push_back(&m_sceneGraph);
     m_shapes = data->shaderShapes;
+    updateLibraryShapes();
+    // Nodes are numbered again below, a frozen group id could now name an unrelated group
+    if (!m_frozenVolumes.empty()) {
+        m_frozenVolumes.clear();
+        needsFreezeBake = true;
+    }
     m_idCounter = 0;
     if (m_sceneSize > 1 && data->nodeData[m_sceneSize - 1].data0.x > 0) {
         for (int i = 0; i < data->nodeData[m_sceneSize - 1].data0.x; i++) {
@@ -357,6 +398,10 @@ void Scene::RecreateScene(SceneData* data) {
     description.showGrid = data->showGrid;
     m_sunPosition = data->sunPosition;
     description.sunPos = data->sunPosition;
+    m_lodDistance = data->lodDistance;
+    description.lodDistance = data->lodDistance;
+    m_lodFootprint = data->lodFootprint;
+    description.lodFootprint = data->lodFootprint;
 
     updateNodeData(false);
 }
@@ -397,6 +442,8 @@ SceneData Scene::CreateSnapshot(bool saveToHistory) {
     data.outlineThickness = m_outlineThickness;
     data.showGrid = m_showGrid;
     data.sunPosition = m_sunPosition;
+    data.lodDistance = m_lodDistance;
+    data.lodFootprint = m_lodFootprint;
     data.shaderShapes = m_shapes;
     if (saveToHistory) {
         performAction(m_tmpSceneData);
@@ -474,6 +521,7 @@ void Scene::Update(int deltaTime) {
         SceneGraphNode* node = GetSceneGraphNode(data->data0.w);
         if (node) { 
             data->transform = node->getTransform()->getWorldTransform(); 
+            data->invWorld = Transform::inverseWorldMatrix(data->transform);
            
             if (!node->isGroup()) {
                 data->object = node->getObject()->getData();
@@ -482,11 +530,39 @@ void Scene::Update(int deltaTime) {
                 data->object[2][2] = node->getMirrorZ();
             }
             data->data0.z = node->getBoolOperation();
+            // BVH groups only cover hard unions, smoothing turned on or off changes which groups qualify
+            if ((node->getGoop() > 0.0f) != (data->data1.x > 0.0f)) {
+                needsRecompilation = true;
+            }
             data->data1.x = node->getGoop();
             data->data1.y = node->getColorGoop();
             data->color = node->getColor();
 		}
 	}
+    computeBounds(m_nodeData.data(), m_sceneSize, getShaderNames());
+    if (m_bvhValid) {
+        refitBvh();
+    }
+
+    // Only the nodes whose own shape or placement changed can make surface appear, and only within their
+    // old or new extent grown by their blend radius. Colors do not matter to distances.
+    for (int i = 0; i < m_sceneSize && !m_sceneGridRebuild; i++) {
+        const NodeData& node = m_nodeData[i];
+        const NodeData& last = m_sceneGridNodes[i];
+        if (node.transform != last.transform || node.object != last.object || node.data1 != last.data1 || node.data0.z != last.data0.z) {
+            m_sceneGridChanges.push_back(glm::vec4(glm::vec3(last.bound), last.bound.w + last.data1.x));
+            m_sceneGridChanges.push_back(glm::vec4(glm::vec3(node.bound), node.bound.w + node.data1.x));
+        }
+    }
+    m_sceneGridNodes = m_nodeData;
+}
+
+bool Scene::takeSceneGridChanges(std::vector<glm::vec4>& spheres) {
+    bool rebuild = m_sceneGridRebuild || int(m_sceneGridChanges.size()) > m_maxSceneGridSpheres;
+    spheres = rebuild ? std::vector<glm::vec4>() : m_sceneGridChanges;
+    m_sceneGridChanges.clear();
+    m_sceneGridRebuild = false;
+    return rebuild;
 }
  
 void Scene::UpdateViewport(glm::vec4 viewport, float aspectRatio) {
@@ -499,6 +575,15 @@ void Scene::updateNodeData(bool saveHistory) {
     m_tmpNodeIndex = 0;
     SerializeNode(&m_sceneGraph);
 	description.sceneSize = m_sceneSize;
+    // Deleted or emptied groups drop their volume, the remaining ones move down and are baked again
+    size_t frozenCount = m_frozenVolumes.size();
+    m_frozenVolumes.erase(std::remove_if(m_frozenVolumes.begin(), m_frozenVolumes.end(), [&](const FrozenVolume& volume) {
+        int index = getNodeIndex(volume.groupId);
+        return index < 0 || m_nodeData[index].data0.x <= 0;
+    }), m_frozenVolumes.end());
+    if (m_frozenVolumes.size() != frozenCount) {
+        needsFreezeBake = true;
+    }
     CreateSnapshot(saveHistory && m_sceneSize > 1);
     needsRecompilation = true;
 }
@@ -557,6 +642,7 @@ void Scene::SerializeNode(SceneGraphNode* root) {
                     serializedNode.object[2][2] = node->getMirrorZ();
                 }
                 serializedNode.transform = node->getTransform()->getWorldTransform();
+                serializedNode.invWorld = Transform::inverseWorldMatrix(serializedNode.transform);
 
                 // Add the current node to the serialized list
                 m_nodeData[m_tmpNodeIndex] = serializedNode;
@@ -579,6 +665,12 @@ void Scene::SerializeNode(SceneGraphNode* root) {
             n.data0.y = nodeToIndexMapping[firstChild];
 		} 
 	}
+    computeBounds(m_nodeData.data(), m_sceneSize, getShaderNames());
+    m_bvhValid = false;
+    // node indices moved, changes can no longer be matched to the previous nodes
+    m_sceneGridRebuild = true;
+    m_sceneGridChanges.clear();
+    m_sceneGridNodes = m_nodeData;
 }
 
 void Scene::AddEmpty(SceneGraphNode* parent, bool isObject, Type shapeType) {
@@ -661,6 +753,20 @@ void Scene::setOutlineThickness(float thickness) {
 	m_tmpSceneData.outlineThickness = thickness;
 }
 
+void Scene::setLodDistance(float distance) {
+	m_lodDistance = distance;
+	description.lodDistance = distance;
+	performAction(m_tmpSceneData);
+	m_tmpSceneData.lodDistance = distance;
+}
+
+void Scene::setLodFootprint(float footprint) {
+	m_lodFootprint = footprint;
+	description.lodFootprint = footprint;
+	performAction(m_tmpSceneData);
+	m_tmpSceneData.lodFootprint = footprint;
+}
+
 void Scene::showGrid(int show) {
 	m_showGrid = show;
 	description.showGrid = show;
@@ -683,31 +789,390 @@ void Scene::RemoveSceneGraphNode(SceneGraphNode* node, bool updateNodes) {
     if (updateNodes) updateNodeData();
 }
 
-std::string Scene::mirrirShader(std::string node, NodeData nodeData) {
-    std::string str = "tmpPos = pos;\n";
-    std::string parentRot = "Rotate(radians(" + node + ".transform[1].x), radians(" + node + ".transform[1].y), radians(" + node + ".transform[1].z))";
+// GLSL literals for baked codegen
+static std::string glslFloat(float value) {
+    std::ostringstream stream;
+    stream << std::setprecision(9) << value;
+    std::string str = stream.str();
+    if (str.find_first_of(".en") == std::string::npos) {
+        str += ".0";
+    }
+    return str;
+}
+
+static std::string glslVec3(glm::vec3 v) {
+    return "vec3(" + glslFloat(v.x) + ", " + glslFloat(v.y) + ", " + glslFloat(v.z) + ")";
+}
+
+static std::string glslMat3x4(const glm::mat3x4& m) {
+    std::string str = "mat3x4(";
+    for (int c = 0; c < 3; c++) {
+        for (int r = 0; r < 4; r++) {
+            str += glslFloat(m[c][r]);
+            str += (c == 2 && r == 3) ? ")" : ", ";
+        }
+    }
+    return str;
+}
+
+// Traversal of Scene::Bvh for subtrees that only take the nearest of their objects, nearer children are
+// visited first and boxes further than the best distance so far are skipped
+static const char* bvhShaderCode = R"(
+#define BVH_STACK_SIZE 32
+
+float bvhBoxDist(vec3 pos, BvhNode node)
+{
+    return length(max(max(node.lo.xyz - pos, pos - node.hi.xyz), 0.0));
+}
+
+// Returns the nearest leaf, its links hold the node and the shape function
+int bvhNearest(int root, vec3 pos, inout float best)
+{
+    int stack[BVH_STACK_SIZE];
+    int top = 0;
+    int nearest = -1;
+    int current = 0;
+    stack[0] = root;
+    while (top >= 0) {
+        current = stack[top--];
+        BvhNode node = SceneBvh.nodes[current];
+        if (bvhBoxDist(pos, node) >= best) {
+            continue;
+        }
+        if (node.links.z == 1) {
+            vec3 local = vec4(pos, 1.0) * SceneNodes.nodes[node.links.x].invWorld;
+            float d = shapeDistance(node.links.y, local, SceneNodes.nodes[node.links.x].obejctData[0]);
+            if (d < best) {
+                best = d;
+                nearest = current;
+            }
+            continue;
+        }
+        bool leftFirst = bvhBoxDist(pos, SceneBvh.nodes[node.links.x]) < bvhBoxDist(pos, SceneBvh.nodes[node.links.y]);
+        stack[++top] = leftFirst ? node.links.y : node.links.x;
+        stack[++top] = leftFirst ? node.links.x : node.links.y;
+    }
+    return nearest;
+}
+
+SDFData bvhMap(int root, vec3 pos)
+{
+    float best = 1e10;
+    int leaf = bvhNearest(root, pos, best);
+    if (leaf < 0) {
+        return SDFData(vec4(best, 0.0, 0.0, 0.0), -1);
+    }
+    int nearest = SceneBvh.nodes[leaf].links.x;
+    return SDFData(vec4(best, SceneNodes.nodes[nearest].color.xyz), SceneNodes.nodes[nearest].data0.w);
+}
+
+float bvhMapDist(int root, vec3 pos)
+{
+    float best = 1e10;
+    bvhNearest(root, pos, best);
+    return best;
+}
+)";
+
+// mapGrad() of a BVH subtree, the gradient of the nearest leaf through the shapeGradient switch
+static const char* bvhGradShaderCode = R"(
+vec4 bvhMapGrad(int root, vec3 pos)
+{
+    float best = 1e10;
+    int leaf = bvhNearest(root, pos, best);
+    if (leaf < 0) {
+        return vec4(best, 0.0, 0.0, 0.0);
+    }
+    ivec4 links = SceneBvh.nodes[leaf].links;
+    mat3x4 invWorld = SceneNodes.nodes[links.x].invWorld;
+    return worldGrad(shapeGradient(links.y, vec4(pos, 1.0) * invWorld, SceneNodes.nodes[links.x].obejctData[0]), invWorld);
+}
+)";
+
+// Distance and local gradient of the library shapes, keyed by the shape they differentiate
+static const std::map<std::string, const char*> builtinShapeGradCode = {
+    { "sdSphere", R"(
+vec4 sdSphereGrad( vec3 p, float radius )
+{
+    float l = length(p);
+    return vec4(l-radius, p/l);
+}
+)" },
+    { "sdRoundBox", R"(
+vec4 sdRoundBoxGrad( vec3 p, vec3 b, float r )
+{
+    vec3 w = abs(p) - b + r;
+    vec3 s = vec3(p.x<0.0?-1.0:1.0, p.y<0.0?-1.0:1.0, p.z<0.0?-1.0:1.0);
+    float g = max(w.x,max(w.y,w.z));
+    if (g > 0.0) {
+        vec3 q = max(w,0.0);
+        float l = length(q);
+        return vec4(l - r, s*q/l);
+    }
+    // inside, the nearest face
+    return vec4(g - r, s*((w.x>w.y && w.x>w.z) ? vec3(1.0,0.0,0.0) : ((w.y>w.z) ? vec3(0.0,1.0,0.0) : vec3(0.0,0.0,1.0))));
+}
+)" },
+    { "sdCylinder", R"(
+vec4 sdCylinderGrad( vec3 p, float h, float r )
+{
+    float l = length(p.xz);
+    vec2 d = abs(vec2(l,p.y)) - vec2(r,h);
+    vec3 side = vec3(p.x, 0.0, p.z)/max(l, 1e-6);
+    vec3 cap = vec3(0.0, p.y<0.0?-1.0:1.0, 0.0);
+    if (max(d.x,d.y) < 0.0) {
+        return vec4(max(d.x,d.y), (d.x>d.y) ? side : cap);
+    }
+    vec2 q = max(d,0.0);
+    float m = length(q);
+    return vec4(m, (q.x*side + q.y*cap)/m);
+}
+)" },
+    { "sdTorus", R"(
+vec4 sdTorusGrad( vec3 p, float ri, float ro )
+{
+    float l = length(p.xz);
+    vec2 t = vec2(l-ri,p.y);
+    float m = length(t);
+    return vec4(m-ro, vec3(p.x*t.x/max(l, 1e-6), t.y, p.z*t.x/max(l, 1e-6))/m);
+}
+)" },
+};
+
+static bool hasMirror(const NodeData& node) {
+    return node.object[2][0] > 0.1f || node.object[2][1] > 0.1f || node.object[2][2] > 0.1f;
+}
+
+// Arguments each shape type takes after p, as slices of obejctData[0], the same for every shape of that type
+static const std::vector<std::string>& shapeArgSlices(Type type) {
+    static const std::map<Type, std::vector<std::string>> slices = {
+        { Type::Sphere, { "x" } },
+        { Type::Box, { "xyz", "w" } },
+        { Type::Cone, { "x", "y", "z" } },
+        { Type::Cylinder, { "x", "y" } },
+        { Type::Pyramid, { "x", "y" } },
+        { Type::Torus, { "x", "y" } },
+    };
+    static const std::vector<std::string> none;
+    auto it = slices.find(type);
+    return it == slices.end() ? none : it->second;
+}
+
+// The argument list of a shape call, arg gives the expression of the n-th slice
+template <typename F>
+static std::string shapeArgList(Type type, F arg) {
+    const std::vector<std::string>& slices = shapeArgSlices(type);
+    std::string list;
+    for (size_t n = 0; n < slices.size(); n++) {
+        list += (n ? ", " : "") + arg(int(n), slices[n]);
+    }
+    return list;
+}
+
+// Cached fragments name nodes relative to their own index, $k$ is the node k places before it,
+// so a moved subtree produces the same text
+static std::string relativeNode(int base, int index) {
+    return "$" + std::to_string(base - index) + "$";
+}
+
+template <typename F>
+static std::string mapRelativeNodes(const std::string& code, F f) {
+    std::string str;
+    str.reserve(code.size());
+    size_t pos = 0;
+    for (size_t start = code.find('$'); start != std::string::npos; start = code.find('$', pos)) {
+        size_t end = code.find('$', start + 1);
+        str.append(code, pos, start - pos);
+        str += f(std::stoi(code.substr(start + 1, end - start - 1)));
+        pos = end + 1;
+    }
+    str.append(code, pos, std::string::npos);
+    return str;
+}
+
+// A child expression embedded into its parent, relative to the parent instead
+static std::string rebaseRelativeNodes(const std::string& code, int delta) {
+    return mapRelativeNodes(code, [&](int k) { return "$" + std::to_string(k + delta) + "$"; });
+}
+
+// Absolute node indices for the final shader
+static std::string resolveRelativeNodes(const std::string& code, int base) {
+    return mapRelativeNodes(code, [&](int k) { return std::to_string(base - k); });
+}
+
+std::string Scene::mirrirShader(const NodeData* nodes, int parentIndex, NodeData nodeData, bool baked, bool grad) {
+    // emitted into the parent's own fragment
+    std::string parentInvWorld = "SceneNodes.nodes[" + relativeNode(parentIndex, parentIndex) + "].invWorld";
+    if (baked) {
+        parentInvWorld = glslMat3x4(nodes[parentIndex].invWorld);
+    }
+    // mapGrad() also tracks the reflections in tmpJac to bring the gradient back to pos
+    std::string str = grad ? "tmpPos = pos;\ntmpJac = mat3(1.0);\n" : "tmpPos = pos;\n";
+    std::string reflect = grad ? "tmpPos = ReflectGrad(tmpPos, tmpJac, " : "tmpPos = Reflect(tmpPos, ";
     if (nodeData.object[2][0] > 0.1f) {
-		str += "tmpPos = Reflect(tmpPos, vec3(1.0,0.0,0.0), " + node + ".transform[2].xyz, " + parentRot + "); \n";
+		str += reflect + "vec3(1.0,0.0,0.0), " + parentInvWorld + ");\n";
 	}
     if (nodeData.object[2][1] > 0.1f) {
-        str += "tmpPos = Reflect(tmpPos, vec3(0.0,1.0,0.0), " + node + ".transform[2].xyz, " + parentRot + ");\n";
+        str += reflect + "vec3(0.0,1.0,0.0), " + parentInvWorld + ");\n";
 	}
 	if (nodeData.object[2][2] > 0.1f) {
-		str += "tmpPos = Reflect(tmpPos, vec3(0.0,0.0,1.0), " + node + ".transform[2].xyz, " + parentRot + ");\n";
+		str += reflect + "vec3(0.0,0.0,1.0), " + parentInvWorld + ");\n";
 	}
 	return str; 
 }
 
-std::string Scene::getAllShapesCode() {
-	std::string shapesCode = "";
+std::vector<std::string> Scene::getShaderNames() {
+    std::vector<std::string> shaderNames(m_sceneSize);
+    for (int i = 0; i < m_sceneSize; i++) {
+        if (m_nodeData[i].data0.x == -1) {
+            SceneGraphNode* sgNode = GetSceneGraphNode(m_nodeData[i].data0.w);
+            shaderNames[i] = sgNode->getObject()->getComponent<Shape>()->getShaderName();
+        }
+    }
+    return shaderNames;
+}
+
+float Scene::shapeBoundingRadius(const NodeData& node, const std::string& shaderName) {
+    // Only library shapes have a known extent, edited or added shape code may reach anywhere
+    if (!m_libraryShapes.count({ Type(int(node.object[1].w)), shaderName })) {
+        return m_unboundedRadius;
+    }
+    glm::vec4 p = glm::abs(node.object[0]);
+    switch (int(node.object[1].w)) {
+        case 0: // Sphere: radius
+            return p.x;
+        case 1: // Box: half size, the rounding stays inside it
+            return glm::length(glm::vec3(p));
+        case 2: // Cone: height, top and bottom radius
+            return glm::length(glm::vec2(0.5f * p.x, std::max(p.y, p.z)));
+        case 3: // Cylinder: half height, radius
+            return glm::length(glm::vec2(p.x, p.y));
+        case 4: // Pyramid: height, base width
+            return glm::length(glm::vec2(p.x, 0.70711f * p.y));
+        case 5: // Torus: ring radius, tube radius
+            return p.x + p.y;
+    }
+    return m_unboundedRadius;
+}
+
+void Scene::computeBounds(NodeData* nodes, int count, const std::vector<std::string>& shaderNames) {
+    // Children are stored before their parents, so every child sphere is final when its group is reached
+    for (int i = 0; i < count; i++) {
+        NodeData& node = nodes[i];
+        glm::vec3 center = glm::vec3(node.transform[2]);
+        if (node.data0.x == -1) { // object
+            node.bound = glm::vec4(center, shapeBoundingRadius(node, shaderNames[i]));
+            continue;
+        }
+        if (node.data0.x == 0) {
+            node.bound = glm::vec4(center, 0.0f);
+            continue;
+        }
+        glm::vec3 lo = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 hi = -lo;
+        float goop = 0.0f;
+        for (int j = 0; j < node.data0.x; ++j) {
+            NodeData& child = nodes[node.data0.y + j];
+            // A mirrored object also shows up reflected across the planes of its group, all copies are
+            // within the same distance of the group origin
+            if (hasMirror(child)) {
+                child.bound = glm::vec4(center, glm::distance(center, glm::vec3(child.bound)) + child.bound.w);
+            }
+            lo = glm::min(lo, glm::vec3(child.bound));
+            hi = glm::max(hi, glm::vec3(child.bound));
+            if (j > 0) {
+                goop = std::max(goop, child.data1.x);
+            }
+        }
+        glm::vec3 groupCenter = 0.5f * (lo + hi);
+        float radius = 0.0f;
+        for (int j = 0; j < node.data0.x; ++j) {
+            const NodeData& child = nodes[node.data0.y + j];
+            radius = std::max(radius, glm::distance(groupCenter, glm::vec3(child.bound)) + child.bound.w);
+        }
+        // Smooth operations move the surface at most a quarter of their radius past the children
+        node.bound = glm::vec4(groupCenter, radius + 0.25f * goop);
+    }
+}
+
+std::string Scene::getUsedShapesCode(const std::vector<std::string>& shaderNames) {
+    // Shapes referenced by a node, plus any shape whose function another used shape calls
+    std::set<std::string> used;
+    for (const std::string& name : shaderNames) {
+        if (!name.empty()) {
+            used.insert(name);
+        }
+    }
+    std::vector<const ShaderShape*> allShapes;
+    for (auto& shapes : m_shapes) {
+        for (auto& shape : shapes.second) {
+            allShapes.push_back(&shape);
+        }
+    }
+    bool added = !used.empty();
+    while (added) {
+        added = false;
+        for (const ShaderShape* shape : allShapes) {
+            if (used.count(shape->name)) {
+                continue;
+            }
+            for (const ShaderShape* other : allShapes) {
+                if (used.count(other->name) && other->code.find(shape->name + "(") != std::string::npos) {
+                    used.insert(shape->name);
+                    added = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    std::string shapesCode = "";
+    size_t totalCount = 0, totalSize = 0, usedCount = 0;
     for (auto& shapes : m_shapes) {
         for (auto& shape : shapes.second) {
-			shapesCode += shape.code;
+            totalCount++;
+            totalSize += shape.code.size();
+            if (used.count(shape.name)) {
+                usedCount++;
+                shapesCode += shape.code;
+            }
 		}
 	}
+    // Only report a new selection, the interpreter always takes every shape and has nothing to report
+    if (usedCount < totalCount && used != m_emittedShapes) {
+        m_emittedShapes = used;
+        std::stringstream message;
+        message << "Shape functions emitted: " << usedCount << " of " << totalCount << " (" << shapesCode.size() << " of " << totalSize << " bytes)";
+        vkLogging::Logger::get_logger()->print(message.str());
+    }
 	return shapesCode + "\n";
 }
 
+std::string Scene::getShapeGradientCode(const std::vector<std::pair<Type, std::string>>& shapes) {
+    std::string code;
+    for (auto& shape : shapes) {
+        const std::string& name = shape.second;
+        auto grad = builtinShapeGradCode.find(name);
+        if (grad != builtinShapeGradCode.end() && m_libraryShapes.count(shape)) {
+            code += grad->second;
+            continue;
+        }
+        // Edited or added shapes only give distances, four taps of the one shape around p
+        std::string params = shapeArgList(shape.first, [](int n, const std::string& slice) {
+            return (slice.size() == 3 ? "vec3 a" : "float a") + std::to_string(n);
+        });
+        std::string args = shapeArgList(shape.first, [](int n, const std::string&) { return "a" + std::to_string(n); });
+        code += "\nvec4 " + name + "Grad( vec3 p, " + params + " )\n{\n";
+        code += "    const vec2 e = vec2(1.0, -1.0) * 0.0005;\n";
+        code += "    float a = " + name + "(p + e.xyy, " + args + ");\n";
+        code += "    float b = " + name + "(p + e.yyx, " + args + ");\n";
+        code += "    float c = " + name + "(p + e.yxy, " + args + ");\n";
+        code += "    float d = " + name + "(p + e.xxx, " + args + ");\n";
+        code += "    return vec4(0.25*(a + b + c + d), (e.xyy*a + e.yyx*b + e.yxy*c + e.xxx*d) / (4.0*0.0005*0.0005));\n}\n";
+    }
+    return code;
+}
+
 std::string Scene::getShaderByName(std::string shaderName, Type type) {
     std::vector<ShaderShape> shapes = m_shapes[type];
     for (auto& shape : shapes) {
@@ -722,92 +1187,790 @@ void Scene::setShaderByName(std::string name, std::string code, Type type) {
     for (auto& shape : m_shapes[type]) {
         if (shape.name == name) {
 			shape.code = code;
+			updateLibraryShapes();
 			return;
 		}
 	}
     AddShape(name, code, type);
 }
 
-std::string Scene::getShaderCode() {
-    m_shaderCode = getAllShapesCode();
-    m_shaderCode += m_shaderBegin;
-    m_shaderCode += "vec3 tmpPos = pos;\n";
-    m_shaderCode += "mat3 rot;\n";
-    if (m_sceneSize <= 1) {
-		m_shaderCode += "return SDFData(vec4(1.0, 0.0, 0.0, 0.0), -1);}\n";
-		return m_shaderCode;
-	}
-    std::vector<std::string> objectsShaders(m_sceneSize);
-    for (int i = 0; i < m_sceneSize; i++) {
-		NodeData node = m_nodeData[i];
-        SceneGraphNode* sgNode = GetSceneGraphNode(node.data0.w);
-        std::string nodeStr = "SceneNodes.nodes["+ std::to_string(i) +"]";
-        bool hasMirror = (node.object[2][0] > 0.1f || node.object[2][1] > 0.1f || node.object[2][2] > 0.1f);
-        if (node.data0.x > 0 && objectsShaders[node.data0.y] != "") { // not empty group
-            std::string gName = "g" + std::to_string(i);
-            std::string result = "";
-            nodeStr = "SceneNodes.nodes[" + std::to_string(node.data0.y) + "]";
-            hasMirror = (m_nodeData[node.data0.y].object[2][0] > 0.1f || m_nodeData[node.data0.y].object[2][1] > 0.1f || m_nodeData[node.data0.y].object[2][2] > 0.1f);
-            result += "rot = Rotate(radians(" + nodeStr + ".transform[1].x), radians(" + nodeStr + ".transform[1].y), radians(" + nodeStr + ".transform[1].z));\n";
-            if (hasMirror) {
-				result += mirrirShader("SceneNodes.nodes[" + std::to_string(i) + "]", m_nodeData[node.data0.y]);
-			}
-            result += "SDFData "+gName + " = "+ objectsShaders[node.data0.y]+";\n";
-            for (int j = 1; j < node.data0.x; ++j) {
-                int childIndex = node.data0.y + j;
-                nodeStr = "SceneNodes.nodes[" + std::to_string(childIndex) + "]";
-                hasMirror = (m_nodeData[childIndex].object[2][0] > 0.1f || m_nodeData[childIndex].object[2][1] > 0.1f || m_nodeData[childIndex].object[2][2] > 0.1f);
-                if (objectsShaders[childIndex] != "") {
-                    result += "rot = Rotate(radians(" + nodeStr + ".transform[1].x), radians(" + nodeStr + ".transform[1].y), radians(" + nodeStr + ".transform[1].z));\n";
-                    if (hasMirror) {
-                        result += mirrirShader("SceneNodes.nodes[" + std::to_string(i) + "]", m_nodeData[childIndex]);
-                    }
-                    switch (m_nodeData[childIndex].data0.z) {
-					    case Union:
-						    result += gName + " = opU("+ objectsShaders[childIndex] +", "+gName+", "+ nodeStr +".data1.x, " + nodeStr + ".data1.y);\n";
-						    break;
-					    case Intersection:
-						    result += gName + " = opI("+ objectsShaders[childIndex] +", "+gName+", " + nodeStr + ".data1.x, " + nodeStr + ".data1.y);\n";
-						    break;
-					    case Difference:
-						    result += gName + " = opS("+ objectsShaders[childIndex] +", "+gName+", " + nodeStr + ".data1.x, " + nodeStr + ".data1.y);\n";
-						    break;
-				    }
+std::string Scene::nodeStructureKey(const ShaderCodegenInput& input, int index, const std::vector<const ShaderFragment*>& fragments, bool asFunction, bool culled) {
+    // Everything the fragment text depends on, with children by offset so the key does not depend on where the subtree sits.
+    // A child stands in by the id of its cached fragment, which names its whole key, so every key stays O(children).
+    const NodeData& node = input.nodes[index];
+    std::string key;
+    auto put = [&](const auto& value) { key.append(reinterpret_cast<const char*>(&value), sizeof(value)); };
+    auto putString = [&](const std::string& str) { put(str.size()); key += str; };
+    put(node.data0.x);
+    put(node.data0.x > 0 ? index - node.data0.y : 0);
+    put(node.data0.w);
+    put(asFunction);
+    put(culled);
+    put(input.bvhRoots.empty() ? -1 : input.bvhRoots[index]);
+    int volume = input.frozenVolumes.empty() ? -1 : input.frozenVolumes[index];
+    put(volume);
+    if (volume >= 0) {
+        put(input.frozenGrids[volume]);
+    }
+    // mirror flags select tmpPos and are read by the parent when emitting its children
+    put(node.object[2][0] > 0.1f);
+    put(node.object[2][1] > 0.1f);
+    put(node.object[2][2] > 0.1f);
+    if (node.data0.x == -1) { // object
+        put(node.object[1].w);
+        putString(input.shaderNames[index]);
+    }
+    else {
+        for (int j = 0; j < node.data0.x; ++j) {
+            int childIndex = node.data0.y + j;
+            put(fragments[childIndex]->id);
+            put(input.nodes[childIndex].data0.z);
+        }
+    }
+    // baked fragments carry their values, so those become part of the key
+    if (!input.live.empty()) {
+        put(static_cast<bool>(input.live[index]));
+        if (!input.live[index]) {
+            put(node.transform);
+            put(node.invWorld);
+            put(node.object);
+            put(node.data1);
+            put(node.color);
+        }
+        if (culled && !input.liveBounds[index]) {
+            put(node.bound);
+        }
+    }
+    return key;
+}
+
+ShaderFragment Scene::emitNodeFragment(const ShaderCodegenInput& input, int i, const std::vector<const ShaderFragment*>& fragments, bool asFunction, bool culled) {
+    // Baked nodes are emitted as literals, the others keep reading the node buffer
+    const NodeData* nodes = input.nodes;
+    auto isBaked = [&](int index) { return !input.live.empty() && !input.live[index]; };
+    auto nodeRef = [&](int index) { return "SceneNodes.nodes[" + relativeNode(i, index) + "]"; };
+    auto param = [&](int index, int component) {
+        if (isBaked(index)) {
+            return glslFloat(nodes[index].object[0][component]);
+        }
+        return nodeRef(index) + ".obejctData[0]." + "xyzw"[component];
+    };
+    auto goop = [&](int index, int component) {
+        if (isBaked(index)) {
+            return glslFloat(nodes[index].data1[component]);
+        }
+        return nodeRef(index) + ".data1." + "xyzw"[component];
+    };
+
+    ShaderFragment fragment;
+    const NodeData& node = nodes[i];
+    if (!input.frozenVolumes.empty() && input.frozenVolumes[i] >= 0) { // frozen group, sampled from its baked volume
+        int volume = input.frozenVolumes[i];
+        glm::vec4 grid = input.frozenGrids[volume];
+        std::string invWorld = isBaked(i) ? glslMat3x4(node.invWorld) : nodeRef(i) + ".invWorld";
+        std::string local = "(vec4(pos, 1.0) * " + invWorld + ")";
+        std::string args = std::to_string(volume) + ", " + local + ", vec4(" + glslVec3(grid) + ", " + glslFloat(grid.w) + ")";
+        fragment.expr = "frozenMap(" + args + ", " + std::to_string(node.data0.w) + ")";
+        fragment.distExpr = "frozenMapDist(" + args + ")";
+        fragment.gradExpr = "worldGrad(frozenMapGrad(" + args + "), " + invWorld + ")";
+    }
+    else if (!input.bvhRoots.empty() && input.bvhRoots[i] >= 0) { // union-only group, its objects come from the BVH buffer
+        fragment.expr = "bvhMap(" + std::to_string(input.bvhRoots[i]) + ", pos)";
+        fragment.distExpr = "bvhMapDist(" + std::to_string(input.bvhRoots[i]) + ", pos)";
+        fragment.gradExpr = "bvhMapGrad(" + std::to_string(input.bvhRoots[i]) + ", pos)";
+    }
+    else if (node.data0.x > 0 && !fragments[node.data0.y]->expr.empty()) { // not empty group
+        // A group emitted as its own function keeps its result in a local and is called by its parent
+        std::string gName = asFunction ? "res" : "g" + relativeNode(i, i);
+        std::string dName = asFunction ? "res" : "d" + relativeNode(i, i);
+        std::string vName = asFunction ? "res" : "v" + relativeNode(i, i);
+        std::string& result = fragment.code;
+        std::string& distResult = fragment.distCode;
+        std::string& gradResult = fragment.gradCode;
+        for (int j = 0; j < node.data0.x; ++j) {
+            int childIndex = node.data0.y + j;
+            std::string childExpr = rebaseRelativeNodes(fragments[childIndex]->expr, i - childIndex);
+            std::string childDistExpr = rebaseRelativeNodes(fragments[childIndex]->distExpr, i - childIndex);
+            std::string childGradExpr = rebaseRelativeNodes(fragments[childIndex]->gradExpr, i - childIndex);
+            if (childExpr.empty()) {
+                continue;
+            }
+            if (fragments[childIndex]->culled) {
+                // Past the current distance plus the blend radius the child can no longer change the union
+                std::string margin = isBaked(childIndex)
+                    ? glslFloat(std::max(nodes[childIndex].data1.x, nodes[childIndex].data1.y))
+                    : "max(" + goop(childIndex, 0) + ", " + goop(childIndex, 1) + ")";
+                childExpr = "g" + relativeNode(i, childIndex) + "(pos, " + gName + ".data.x + " + margin + ")";
+                childDistExpr = "gd" + relativeNode(i, childIndex) + "(pos, " + dName + " + " + goop(childIndex, 0) + ")";
+                childGradExpr = "gg" + relativeNode(i, childIndex) + "(pos, " + vName + ".x + " + goop(childIndex, 0) + ")";
+            }
+            if (hasMirror(nodes[childIndex])) {
+                std::string mirror = mirrirShader(nodes, i, nodes[childIndex], isBaked(i));
+                result += mirror;
+                distResult += mirror;
+                gradResult += mirrirShader(nodes, i, nodes[childIndex], isBaked(i), true);
+            }
+            if (j == 0) {
+                result += "SDFData " + gName + " = " + childExpr + ";\n";
+                distResult += "float " + dName + " = " + childDistExpr + ";\n";
+                gradResult += "vec4 " + vName + " = " + childGradExpr + ";\n";
+                continue;
+            }
+            std::string args = childExpr + ", " + gName + ", " + goop(childIndex, 0) + ", " + goop(childIndex, 1);
+            std::string distArgs = childDistExpr + ", " + dName + ", " + goop(childIndex, 0);
+            std::string gradArgs = childGradExpr + ", " + vName + ", " + goop(childIndex, 0);
+            switch (nodes[childIndex].data0.z) {
+                case Union:
+                    result += gName + " = opU(" + args + ");\n";
+                    distResult += dName + " = opUd(" + distArgs + ");\n";
+                    gradResult += vName + " = opUg(" + gradArgs + ");\n";
+                    break;
+                case Intersection:
+                    result += gName + " = opI(" + args + ");\n";
+                    distResult += dName + " = opId(" + distArgs + ");\n";
+                    gradResult += vName + " = opIg(" + gradArgs + ");\n";
+                    break;
+                case Difference:
+                    result += gName + " = opS(" + args + ");\n";
+                    distResult += dName + " = opSd(" + distArgs + ");\n";
+                    gradResult += vName + " = opSg(" + gradArgs + ");\n";
+                    break;
+            }
+        }
+        fragment.expr = asFunction ? "g" + relativeNode(i, i) + "(pos)" : gName;
+        fragment.distExpr = asFunction ? "gd" + relativeNode(i, i) + "(pos)" : dName;
+        fragment.gradExpr = asFunction ? "gg" + relativeNode(i, i) + "(pos)" : vName;
+        fragment.function = asFunction;
+        fragment.culled = culled;
+        if (culled) {
+            std::string bound = nodeRef(i) + ".bound";
+            if (!input.live.empty() && !input.liveBounds[i]) {
+                bound = "vec4(" + glslVec3(node.bound) + ", " + glslFloat(node.bound.w) + ")";
+            }
+            fragment.boundExpr = "length(pos - " + bound + ".xyz) - " + bound + ".w";
+        }
+    }
+    else if (node.data0.x == -1) { // object
+        std::string p = hasMirror(node) ? "tmpPos" : "pos";
+        std::string invWorld = nodeRef(i) + ".invWorld";
+        std::string color = nodeRef(i) + ".color.xyz";
+        if (isBaked(i)) {
+            invWorld = glslMat3x4(node.invWorld);
+            color = glslVec3(node.color);
+        }
+        std::string pos = "(vec4(" + p + ", 1.0) * " + invWorld + ")";
+        Type type = Type(int(node.object[1].w));
+        if (shapeArgSlices(type).empty()) {
+            return fragment;
+        }
+        std::string args = shapeArgList(type, [&](int, const std::string& slice) {
+            if (slice.size() == 1) {
+                return param(i, int(std::string("xyzw").find(slice)));
+            }
+            return isBaked(i) ? glslVec3(node.object[0]) : nodeRef(i) + ".obejctData[0]." + slice;
+        });
+        fragment.distExpr = input.shaderNames[i] + "(" + pos + ", " + args + ")";
+        fragment.expr = "SDFData(vec4(" + fragment.distExpr + ", " + color + "), " + std::to_string(node.data0.w) + ")";
+        // The shape gradient is in its local space, a mirrored copy also goes back through the reflections
+        fragment.gradExpr = "worldGrad(" + input.shaderNames[i] + "Grad(" + pos + ", " + args + "), " + invWorld + (hasMirror(node) ? ", tmpJac)" : ")");
+    }
+    return fragment;
+}
+
+std::vector<bool> Scene::getLiveNodes() {
+    // The selected node and everything below it, parents are stored after their children
+    std::vector<bool> live(m_sceneSize, false);
+    for (int i = m_sceneSize - 1; i >= 0; i--) {
+        if (m_nodeData[i].data0.w == m_selectedObjectId) {
+            live[i] = true;
+        }
+        if (live[i] && m_nodeData[i].data0.x > 0) {
+            for (int j = 0; j < m_nodeData[i].data0.x; ++j) {
+                live[m_nodeData[i].data0.y + j] = true;
+            }
+        }
+    }
+    return live;
+}
+
+std::string Scene::getShaderCode(codegenMode mode) {
+    ShaderCodegenInput input;
+    input.nodes = m_nodeData.data();
+    input.count = m_sceneSize;
+    input.groupFunctionMinNodes = m_groupFunctionMinNodes;
+    input.boundsCulling = m_boundsCulling;
+    input.gradients = m_analyticGradients;
+    input.shaderNames = getShaderNames();
+    if (mode == codegenMode::BAKED) {
+        input.live = getLiveNodes();
+    }
+    else if (mode == codegenMode::BAKED_ALL) {
+        input.live.assign(m_sceneSize, false);
+    }
+    if (int(m_bvhRoots.size()) == m_sceneSize) {
+        input.bvhRoots = m_bvhRoots;
+    }
+    if (!m_frozenVolumes.empty()) {
+        input.frozenVolumes.assign(m_sceneSize, -1);
+        for (int v = 0; v < int(m_frozenVolumes.size()); v++) {
+            input.frozenVolumes[getNodeIndex(m_frozenVolumes[v].groupId)] = v;
+            input.frozenGrids.push_back(m_frozenVolumes[v].grid);
+        }
+    }
+    if (!input.live.empty()) {
+        // A group's bound follows every node below it, so it stays live while any of them is
+        input.liveBounds = input.live;
+        for (int i = 0; i < m_sceneSize; i++) {
+            for (int j = 0; j < m_nodeData[i].data0.x; ++j) {
+                if (input.liveBounds[m_nodeData[i].data0.y + j]) {
+                    input.liveBounds[i] = true;
                 }
             }
-            m_shaderCode += result;
-            objectsShaders[i] = gName;
         }
-        else if (node.data0.x == -1) { // object
-            std::string p = (hasMirror) ? "tmpPos" : "pos";
-            std::string pos = "(rot * ("+p+" - " + nodeStr + ".transform[2].xyz))";
-            std::string shaderName = sgNode->getObject()->getComponent<Shape>()->getShaderName();
-            if (node.object[1].w == 0) { // Sphere
-                objectsShaders[i] = "SDFData(vec4("+ shaderName + "(" + pos + ", " + nodeStr + ".obejctData[0].x), " + nodeStr + ".color.xyz), " + std::to_string(node.data0.w) + ")";
+    }
+    return generateShaderCode(input);
+}
+
+std::map<std::pair<int, std::string>, int> Scene::getShapeFunctionIndices() {
+    // Shape functions are numbered in library order, matching shapeDistance in getInterpreterShaderCode
+    std::map<std::pair<int, std::string>, int> shapeIndex;
+    int shapeCount = 0;
+    for (auto& shapes : m_shapes) {
+        for (auto& shape : shapes.second) {
+            shapeIndex[{ int(shapes.first), shape.name }] = shapeCount++;
+        }
+    }
+    return shapeIndex;
+}
+
+void Scene::updateBytecode() {
+    std::map<std::pair<int, std::string>, int> shapeIndex = getShapeFunctionIndices();
+
+    // Same traversal as the generated map(): empty groups and unknown shapes produce nothing
+    int count = 0, depth = 0, maxDepth = 0;
+    bool valid = true;
+    std::function<bool(int, int)> emit = [&](int i, int parent) {
+        const NodeData& node = m_nodeData[i];
+        if (node.data0.x == -1) {
+            int type = int(node.object[1].w);
+            if (type < 0 || type > 5) {
+                return false;
             }
-            else if (node.object[1].w == 1) { // Box
-                objectsShaders[i] = "SDFData(vec4(" + shaderName + "("+pos+", " + nodeStr + ".obejctData[0].xyz, " + nodeStr + ".obejctData[0].w), " + nodeStr + ".color.xyz), " + std::to_string(node.data0.w) + ")";
+            SceneGraphNode* sgNode = GetSceneGraphNode(node.data0.w);
+            auto it = shapeIndex.find({ type, sgNode->getObject()->getComponent<Shape>()->getShaderName() });
+            if (it == shapeIndex.end()) {
+                valid = false;
+                return false;
             }
-            else if (node.object[1].w == 2) { // Cone
-                objectsShaders[i] = "SDFData(vec4(" + shaderName + "(" + pos + ", " + nodeStr + ".obejctData[0].x, " + nodeStr + ".obejctData[0].y, " + nodeStr + ".obejctData[0].z), " + nodeStr + ".color.xyz), " + std::to_string(node.data0.w) + ")";
+            m_bytecode.code[count++] = glm::ivec4(0, i, parent, it->second);
+            maxDepth = std::max(maxDepth, ++depth);
+            return true;
+        }
+        if (node.data0.x <= 0 || !emit(node.data0.y, i)) {
+            return false;
+        }
+        for (int j = 1; j < node.data0.x; ++j) {
+            int childIndex = node.data0.y + j;
+            // Culled union groups are preceded by a bound test that jumps to their combine
+            int boundTest = -1;
+            if (m_boundsCulling && m_nodeData[childIndex].data0.x > 0 && m_nodeData[childIndex].data0.z == Union) {
+                boundTest = count++;
             }
-            else if (node.object[1].w == 3) { // Cylinder
-            	objectsShaders[i] = "SDFData(vec4(" + shaderName + "(" + pos + ", " + nodeStr + ".obejctData[0].x, " + nodeStr + ".obejctData[0].y), " + nodeStr + ".color.xyz), " + std::to_string(node.data0.w) + ")";
+            if (emit(childIndex, i)) {
+                if (boundTest >= 0) {
+                    m_bytecode.code[boundTest] = glm::ivec4(2, childIndex, count, 0);
+                }
+                m_bytecode.code[count++] = glm::ivec4(1, childIndex, i, 0);
+                depth--;
             }
-            else if (node.object[1].w == 4) { // Pyramid
-            	objectsShaders[i] = "SDFData(vec4(" + shaderName + "(" + pos + ", " + nodeStr + ".obejctData[0].x, " + nodeStr + ".obejctData[0].y), " + nodeStr + ".color.xyz), " + std::to_string(node.data0.w) + ")";
+            else if (boundTest >= 0) {
+                count = boundTest;
+            }
+        }
+        return true;
+    };
+    if (m_sceneSize > 1) {
+        emit(m_sceneSize - 1, m_sceneSize - 1);
+    }
+    valid = valid && maxDepth <= m_maxInterpreterStack;
+    m_bytecode.header = glm::ivec4(valid ? count : 0, maxDepth, valid, 0);
+}
+
+void Scene::updateBvh() {
+    std::map<std::pair<int, std::string>, int> shapeIndex = getShapeFunctionIndices();
+    std::vector<std::string> shaderNames = getShaderNames();
+    m_bvhRoots.assign(m_sceneSize, -1);
+    m_bvh.header = glm::ivec4(0);
+    m_bvhValid = true;
+    if (m_bvhMinObjects <= 0) {
+        return;
+    }
+
+    // A subtree qualifies when it only combines library shapes without mirrors through hard unions,
+    // then its distance is the nearest object in any order and the hierarchy gives the exact same result
+    std::vector<bool> unionOnly(m_sceneSize, false);
+    std::vector<int> objectCount(m_sceneSize, 0);
+    for (int i = 0; i < m_sceneSize; i++) {
+        const NodeData& node = m_nodeData[i];
+        if (node.data0.x == -1) {
+            unionOnly[i] = !hasMirror(node) && shapeIndex.count({ int(node.object[1].w), shaderNames[i] });
+            objectCount[i] = 1;
+            continue;
+        }
+        unionOnly[i] = node.data0.x > 0 && !isFrozen(node.data0.w);
+        for (int j = 0; j < node.data0.x; ++j) {
+            int childIndex = node.data0.y + j;
+            const NodeData& child = m_nodeData[childIndex];
+            unionOnly[i] = unionOnly[i] && unionOnly[childIndex] && (j == 0 || (child.data0.z == Union && child.data1.x <= 0.0f));
+            objectCount[i] += objectCount[childIndex];
+        }
+    }
+
+    // Only the outermost qualifying group gets a hierarchy, its parents are stored after it
+    std::vector<bool> covered(m_sceneSize, false);
+    int nextNode = 0;
+    for (int i = m_sceneSize - 1; i >= 0; i--) {
+        const NodeData& node = m_nodeData[i];
+        covered[i] = covered[i] || isFrozen(node.data0.w); // drawn from its volume
+        if (!covered[i] && node.data0.x > 0 && unionOnly[i] && objectCount[i] >= std::max(m_bvhMinObjects, 2)) {
+            std::vector<BvhPrimitive> primitives;
+            std::function<void(int)> collect = [&](int index) {
+                const NodeData& n = m_nodeData[index];
+                if (n.data0.x == -1) {
+                    glm::vec3 center = glm::vec3(n.bound);
+                    primitives.push_back({ index, shapeIndex[{ int(n.object[1].w), shaderNames[index] }], center - n.bound.w, center + n.bound.w });
+                }
+                for (int j = 0; j < n.data0.x; ++j) {
+                    collect(n.data0.y + j);
+                }
+            };
+            collect(i);
+            m_bvhRoots[i] = buildBvh(primitives, 0, int(primitives.size()), nextNode, 0);
+            covered[i] = true;
+        }
+        for (int j = 0; j < node.data0.x; ++j) {
+            covered[node.data0.y + j] = covered[i];
+        }
+    }
+    m_bvh.header = glm::ivec4(nextNode, 0, 0, 0);
+    refitBvh();
+}
+
+int Scene::buildBvh(std::vector<BvhPrimitive>& primitives, int begin, int end, int& nextNode, int depth) {
+    int index = nextNode++;
+    if (end - begin == 1) {
+        m_bvh.nodes[index].links = glm::ivec4(primitives[begin].node, primitives[begin].shape, 1, 0);
+        return index;
+    }
+
+    // Surface area heuristic over the centroid sorted splits of every axis, plain median splits further down
+    auto byCenter = [&](int axis) {
+        std::sort(primitives.begin() + begin, primitives.begin() + end, [axis](const BvhPrimitive& a, const BvhPrimitive& b) {
+            return a.lo[axis] + a.hi[axis] < b.lo[axis] + b.hi[axis];
+        });
+    };
+    auto area = [](glm::vec3 lo, glm::vec3 hi) {
+        glm::vec3 d = hi - lo;
+        return d.x * d.y + d.y * d.z + d.z * d.x;
+    };
+    int bestAxis = depth % 3;
+    int bestSplit = begin + (end - begin) / 2;
+    if (depth < m_maxBvhSahDepth) {
+        float bestCost = std::numeric_limits<float>::max();
+        std::vector<float> leftArea(end - begin);
+        for (int axis = 0; axis < 3; axis++) {
+            byCenter(axis);
+            glm::vec3 lo = glm::vec3(std::numeric_limits<float>::max());
+            glm::vec3 hi = -lo;
+            for (int k = begin; k < end; k++) {
+                lo = glm::min(lo, primitives[k].lo);
+                hi = glm::max(hi, primitives[k].hi);
+                leftArea[k - begin] = area(lo, hi);
             }
-            else if (node.object[1].w == 5) { // Torus
-            	objectsShaders[i] = "SDFData(vec4(" + shaderName + "(" + pos + ", " + nodeStr + ".obejctData[0].x, " + nodeStr + ".obejctData[0].y), " + nodeStr + ".color.xyz), " + std::to_string(node.data0.w) + ")";
+            lo = glm::vec3(std::numeric_limits<float>::max());
+            hi = -lo;
+            for (int k = end - 1; k > begin; k--) {
+                lo = glm::min(lo, primitives[k].lo);
+                hi = glm::max(hi, primitives[k].hi);
+                float cost = leftArea[k - 1 - begin] * (k - begin) + area(lo, hi) * (end - k);
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = k;
+                }
             }
         }
-	}
-    if (objectsShaders[m_sceneSize - 1] == "") {
-        m_shaderCode += "return SDFData(vec4(1.0, 0.0, 0.0, 0.0), -1);}\n";
-        return m_shaderCode;
     }
-    m_shaderCode += "return "+ objectsShaders[m_sceneSize-1] + ";\n}\n\n";
-	return m_shaderCode;
+    byCenter(bestAxis);
+    int left = buildBvh(primitives, begin, bestSplit, nextNode, depth + 1);
+    int right = buildBvh(primitives, bestSplit, end, nextNode, depth + 1);
+    m_bvh.nodes[index].links = glm::ivec4(left, right, 0, 0);
+    return index;
+}
+
+int Scene::getNodeIndex(int id) {
+    for (int i = 0; i < m_sceneSize; i++) {
+        if (m_nodeData[i].data0.w == id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool Scene::isFrozen(int id) {
+    return std::any_of(m_frozenVolumes.begin(), m_frozenVolumes.end(), [id](const FrozenVolume& volume) { return volume.groupId == id; });
+}
+
+bool Scene::freezeGroup(int id) {
+    int index = getNodeIndex(id);
+    SceneGraphNode* sgNode = GetSceneGraphNode(id);
+    // Edited shapes have no known extent, so a group holding one cannot be given a finite volume
+    if (index < 0 || m_nodeData[index].data0.x <= 0 || m_nodeData[index].bound.w >= m_unboundedRadius || isFrozen(id)) {
+        return false;
+    }
+    for (SceneGraphNode* ancestor = sgNode->getParent(); ancestor != nullptr; ancestor = ancestor->getParent()) {
+        if (isFrozen(ancestor->getId())) {
+            return false;
+        }
+    }
+    // Frozen groups below this one are baked into its volume
+    m_frozenVolumes.erase(std::remove_if(m_frozenVolumes.begin(), m_frozenVolumes.end(), [&](const FrozenVolume& volume) {
+        for (SceneGraphNode* node = GetSceneGraphNode(volume.groupId); node != nullptr; node = node->getParent()) {
+            if (node == sgNode) {
+                return true;
+            }
+        }
+        return false;
+    }), m_frozenVolumes.end());
+    if (int(m_frozenVolumes.size()) >= m_maxFrozenVolumes) {
+        return false;
+    }
+
+    // A cube around the bounding sphere in the group's local space, so moving the group keeps its volume valid
+    const NodeData& group = m_nodeData[index];
+    glm::vec3 center = glm::vec4(glm::vec3(group.bound), 1.0f) * group.invWorld;
+    float halfSize = 1.1f * group.bound.w;
+    float cellSize = 2.0f * halfSize / float(m_frozenBricks * m_frozenCells);
+    m_frozenVolumes.push_back({ id, glm::vec4(center - halfSize, cellSize) });
+    needsFreezeBake = true;
+    needsRecompilation = true;
+    return true;
+}
+
+void Scene::unfreezeGroup(int id) {
+    size_t frozenCount = m_frozenVolumes.size();
+    m_frozenVolumes.erase(std::remove_if(m_frozenVolumes.begin(), m_frozenVolumes.end(), [id](const FrozenVolume& volume) {
+        return volume.groupId == id;
+    }), m_frozenVolumes.end());
+    if (m_frozenVolumes.size() != frozenCount) {
+        needsFreezeBake = true;
+        needsRecompilation = true;
+    }
+}
+
+std::string Scene::getFreezeShaderCode(int volume) {
+    // The frozen group on its own and fully baked, renumbered with its children still stored first
+    const FrozenVolume& frozen = m_frozenVolumes[volume];
+    int root = getNodeIndex(frozen.groupId);
+    std::vector<int> subtree;
+    std::function<void(int)> collect = [&](int index) {
+        subtree.push_back(index);
+        for (int j = 0; j < m_nodeData[index].data0.x; ++j) {
+            collect(m_nodeData[index].data0.y + j);
+        }
+    };
+    collect(root);
+    std::sort(subtree.begin(), subtree.end());
+    std::unordered_map<int, int> remap;
+    for (int k = 0; k < int(subtree.size()); k++) {
+        remap[subtree[k]] = k;
+    }
+
+    std::vector<std::string> shaderNames = getShaderNames();
+    std::vector<NodeData> nodes(subtree.size());
+    ShaderCodegenInput input;
+    input.count = int(subtree.size());
+    input.groupFunctionMinNodes = m_groupFunctionMinNodes;
+    input.boundsCulling = m_boundsCulling;
+    input.shaderNames.resize(subtree.size());
+    input.live.assign(subtree.size(), false);
+    input.liveBounds.assign(subtree.size(), false);
+    for (int k = 0; k < int(subtree.size()); k++) {
+        nodes[k] = m_nodeData[subtree[k]];
+        if (nodes[k].data0.x > 0) {
+            nodes[k].data0.y = remap[nodes[k].data0.y];
+        }
+        input.shaderNames[k] = shaderNames[subtree[k]];
+    }
+    nodes.back().data0.z = -1;
+    input.nodes = nodes.data();
+    std::string shaderCode = generateShaderCode(input);
+
+    // freeze.comp samples the volume in group local space, world = origin + rotation * local
+    const NodeData& group = m_nodeData[root];
+    glm::mat3 rotation = glm::mat3_cast(Transform::worldRotation(group.transform));
+    shaderCode += "#define FREEZE_VOLUME " + std::to_string(volume) + "\n";
+    shaderCode += "const vec4 FREEZE_GRID = vec4(" + glslVec3(frozen.grid) + ", " + glslFloat(frozen.grid.w) + ");\n";
+    shaderCode += "const vec3 FREEZE_ORIGIN = " + glslVec3(glm::vec3(group.transform[2])) + ";\n";
+    shaderCode += "const mat3 FREEZE_ROTATION = mat3(" + glslVec3(rotation[0]) + ", " + glslVec3(rotation[1]) + ", " + glslVec3(rotation[2]) + ");\n";
+    return shaderCode;
+}
+
+void Scene::refitBvh() {
+    // Children are allocated after their parent, walking backwards visits them first
+    for (int i = m_bvh.header.x - 1; i >= 0; i--) {
+        BvhNode& node = m_bvh.nodes[i];
+        if (node.links.z == 1) {
+            glm::vec4 bound = m_nodeData[node.links.x].bound;
+            node.lo = glm::vec4(glm::vec3(bound) - bound.w, 0.0f);
+            node.hi = glm::vec4(glm::vec3(bound) + bound.w, 0.0f);
+        }
+        else {
+            node.lo = glm::min(m_bvh.nodes[node.links.x].lo, m_bvh.nodes[node.links.y].lo);
+            node.hi = glm::max(m_bvh.nodes[node.links.x].hi, m_bvh.nodes[node.links.y].hi);
+        }
+    }
+}
+
+std::string Scene::getInterpreterShaderCode() {
+    // Every shape in the library plus a switch over them, so the interpreter only changes when shape code does
+    std::vector<std::string> names;
+    std::string dispatch = "float shapeDistance(int shape, vec3 p, vec4 a) {\n    switch (shape) {\n";
+    int shapeCount = 0;
+    for (auto& shapes : m_shapes) {
+        std::string args = shapeArgList(shapes.first, [](int, const std::string& slice) { return "a." + slice; });
+        for (auto& shape : shapes.second) {
+            names.push_back(shape.name);
+            dispatch += "        case " + std::to_string(shapeCount++) + ": return " + shape.name + "(p, " + args + ");\n";
+        }
+    }
+    dispatch += "    }\n    return 1e10;\n}\n";
+    return getUsedShapesCode(names) + dispatch;
+}
+
+std::string Scene::getBenchmarkShaderCode(int nodeCount, int groupFunctionMinNodes, bool boundsCulling) {
+    // Synthetic scene of spheres under a tree of union groups with a fixed seed, so every run emits the same code.
+    // The tree is laid out breadth first and then reversed, which keeps siblings contiguous and children before parents.
+    const int branching = 4;
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<NodeData> nodes(nodeCount);
+    ShaderCodegenInput input;
+    input.count = nodeCount;
+    input.groupFunctionMinNodes = groupFunctionMinNodes;
+    input.boundsCulling = boundsCulling;
+    input.shaderNames.resize(nodeCount);
+    input.live.assign(nodeCount, false); // baked, the node buffer only holds the edited scene
+    input.liveBounds.assign(nodeCount, false);
+    for (int b = 0; b < nodeCount; b++) {
+        NodeData& node = nodes[nodeCount - 1 - b];
+        node = NodeData();
+        int firstChild = branching * b + 1;
+        if (firstChild < nodeCount) {
+            int lastChild = std::min(firstChild + branching - 1, nodeCount - 1);
+            node.data0 = glm::ivec4(lastChild - firstChild + 1, nodeCount - 1 - lastChild, Union, b);
+            node.data1 = glm::vec4(0.1f, 0.1f, 0.0f, 0.0f);
+        }
+        else {
+            node.data0 = glm::ivec4(-1, 0, Union, b);
+            node.data1 = glm::vec4(0.1f, 0.1f, 0.0f, 0.0f);
+            node.transform[1] = glm::vec4(unit(rng) * 360.0f, unit(rng) * 360.0f, unit(rng) * 360.0f, 0.0f);
+            node.transform[2] = glm::vec4(unit(rng) * 20.0f - 10.0f, unit(rng) * 20.0f - 10.0f, unit(rng) * 20.0f - 10.0f, 1.0f);
+            node.object[0] = glm::vec4(0.2f + unit(rng) * 0.3f, 0.0f, 0.0f, 0.0f);
+            node.object[1].w = 0; // Sphere
+            node.color = glm::vec4(unit(rng), unit(rng), unit(rng), 1.0f);
+            input.shaderNames[nodeCount - 1 - b] = m_shapes[Type::Sphere][0].name;
+        }
+        node.invWorld = Transform::inverseWorldMatrix(node.transform);
+    }
+    computeBounds(nodes.data(), nodeCount, input.shaderNames);
+    input.nodes = nodes.data();
+    return generateShaderCode(input);
+}
+
+std::string Scene::generateShaderCode(const ShaderCodegenInput& input) {
+    const int count = input.count;
+    // BVH leaves pick their shape function at run time, so those shaders carry the whole library
+    bool useBvh = std::any_of(input.bvhRoots.begin(), input.bvhRoots.end(), [](int root) { return root >= 0; });
+    std::string shapesCode = useBvh ? getInterpreterShaderCode() + bvhShaderCode : getUsedShapesCode(input.shaderNames);
+    if (input.gradients && count > 1) {
+        // The same shapes differentiated, a BVH leaf picks its gradient at run time like its distance
+        std::vector<std::pair<Type, std::string>> gradShapes;
+        if (useBvh) {
+            std::string dispatch = "vec4 shapeGradient(int shape, vec3 p, vec4 a) {\n    switch (shape) {\n";
+            for (auto& shapes : m_shapes) {
+                std::string args = shapeArgList(shapes.first, [](int, const std::string& slice) { return "a." + slice; });
+                for (auto& shape : shapes.second) {
+                    dispatch += "        case " + std::to_string(gradShapes.size()) + ": return " + shape.name + "Grad(p, " + args + ");\n";
+                    gradShapes.push_back({ shapes.first, shape.name });
+                }
+            }
+            dispatch += "    }\n    return vec4(1e10, 0.0, 0.0, 0.0);\n}\n";
+            shapesCode += getShapeGradientCode(gradShapes) + dispatch + bvhGradShaderCode;
+        }
+        else {
+            std::set<std::pair<Type, std::string>> used;
+            for (int i = 0; i < count; i++) {
+                if (input.nodes[i].data0.x == -1 && !input.shaderNames[i].empty()) {
+                    used.insert({ Type(int(input.nodes[i].object[1].w)), input.shaderNames[i] });
+                }
+            }
+            gradShapes.assign(used.begin(), used.end());
+            shapesCode += getShapeGradientCode(gradShapes);
+        }
+    }
+    std::string shaderCode;
+    if (count <= 1) {
+        shaderCode += shapesCode;
+        shaderCode += m_shaderBegin;
+        shaderCode += "vec3 tmpPos = pos;\n";
+        shaderCode += "return SDFData(vec4(1.0, 0.0, 0.0, 0.0), -1);}\n";
+        shaderCode += m_distShaderBegin;
+        shaderCode += "return 1.0;}\n";
+        if (input.gradients) {
+            shaderCode += "#define MAP_GRAD\n";
+            shaderCode += m_gradShaderBegin;
+            shaderCode += "return vec4(1.0, 0.0, 0.0, 0.0);}\n";
+        }
+        return shaderCode;
+    }
+
+    // Nodes are stored children first, so every child fragment is resolved before its parent.
+    // Unchanged subtrees key the same wherever they sit and reuse their cached GLSL, only the dirty path to the root is emitted again.
+    m_codegenGeneration++;
+    std::vector<int> subtreeSize(count, 1);
+    std::vector<int> parent(count, -1);
+    std::vector<const ShaderFragment*> fragments(count, nullptr);
+    for (int i = 0; i < count; i++) {
+        const NodeData& node = input.nodes[i];
+        for (int j = 0; j < node.data0.x; ++j) {
+            subtreeSize[i] += subtreeSize[node.data0.y + j];
+            parent[node.data0.y + j] = i;
+        }
+    }
+    // Nodes below a BVH group or a frozen group are evaluated by its traversal or its volume and emit nothing themselves
+    auto replaced = [&](int i) {
+        return (useBvh && input.bvhRoots[i] >= 0) || (!input.frozenVolumes.empty() && input.frozenVolumes[i] >= 0);
+    };
+    std::vector<bool> hidden(count, false);
+    for (int i = count - 1; i >= 0; i--) {
+        hidden[i] = parent[i] >= 0 && (hidden[parent[i]] || replaced(parent[i]));
+    }
+    for (int i = 0; i < count; i++) {
+        const NodeData& node = input.nodes[i];
+        bool opaque = hidden[i] || replaced(i);
+        // Groups unioned into an accumulated sibling result can skip themselves when that result is closer than their bound
+        bool culled = input.boundsCulling && !opaque && node.data0.x > 0 && parent[i] >= 0 &&
+            input.nodes[parent[i]].data0.y != i && node.data0.z == Union;
+        bool asFunction = culled || (!opaque && input.groupFunctionMinNodes > 0 && node.data0.x > 0 && subtreeSize[i] >= input.groupFunctionMinNodes);
+        std::string key = nodeStructureKey(input, i, fragments, asFunction, culled);
+        size_t hash = std::hash<std::string>{}(key);
+        auto range = m_fragmentCache.equal_range(hash);
+        auto it = std::find_if(range.first, range.second, [&](const auto& entry) { return entry.second.key == key; });
+        if (it == range.second) {
+            ShaderFragment fragment = emitNodeFragment(input, i, fragments, asFunction, culled);
+            fragment.key = std::move(key);
+            fragment.id = m_nextFragmentId++;
+            it = m_fragmentCache.emplace(hash, std::move(fragment));
+        }
+        it->second.lastUsed = m_codegenGeneration;
+        fragments[i] = &it->second;
+    }
+
+    // Every statement goes into the body of the closest enclosing group function, or into map() when there is none.
+    // Without group functions this is the single flat map() body in node order.
+    std::vector<int> region(count, -1);
+    for (int i = count - 1; i >= 0; i--) {
+        region[i] = fragments[i]->function ? i : (parent[i] >= 0 ? region[parent[i]] : -1);
+    }
+
+    // Size the output before assembling it: the fragment text of every emitted variant plus the function and
+    // map() wrappers around it, with some slack for node names that grow when resolved
+    size_t codeSize = shapesCode.size() + m_shaderBegin.size() + m_distShaderBegin.size() + m_gradShaderBegin.size() + 512;
+    for (int i = 0; i < count; i++) {
+        if (hidden[i]) {
+            continue;
+        }
+        const ShaderFragment* f = fragments[i];
+        codeSize += f->code.size() + f->distCode.size() + 32;
+        if (input.gradients) {
+            codeSize += f->gradCode.size() + 16;
+        }
+        if (f->function) {
+            codeSize += 3 * (f->boundExpr.size() + 160);
+        }
+    }
+    const ShaderFragment* rootFragment = fragments[count - 1];
+    codeSize += rootFragment->expr.size() + rootFragment->distExpr.size() + rootFragment->gradExpr.size();
+    shaderCode.reserve(codeSize);
+
+    // map() carries color and id for the final hit, mapDist() is the same tree on plain floats for
+    // marching, AO and shadows, mapGrad() the same tree on distance and gradient for normals
+    shaderCode += shapesCode;
+    enum { MAP, MAP_DIST, MAP_GRAD };
+    auto emitMap = [&](int variant) {
+        auto variantCode = [&](const ShaderFragment* f) -> const std::string& {
+            return variant == MAP ? f->code : variant == MAP_DIST ? f->distCode : f->gradCode;
+        };
+        const char* tmpDecl = variant == MAP_GRAD ? "vec3 tmpPos = pos;\nmat3 tmpJac = mat3(1.0);\n" : "vec3 tmpPos = pos;\n";
+        std::vector<std::string> functionBodies(count);
+        std::string mapBody;
+        for (int i = 0; i < count; i++) {
+            if (!hidden[i]) {
+                (region[i] == -1 ? mapBody : functionBodies[region[i]]) += resolveRelativeNodes(variantCode(fragments[i]), i);
+            }
+        }
+        // Children are stored before their parents, so every function is defined before it is called
+        for (int i = 0; i < count; i++) {
+            if (fragments[i]->function && !hidden[i]) {
+                shaderCode += (variant == MAP ? "SDFData g" : variant == MAP_DIST ? "float gd" : "vec4 gg") + std::to_string(i);
+                shaderCode += fragments[i]->culled ? "(in vec3 pos, in float cull) {\n" : "(in vec3 pos) {\n";
+                if (fragments[i]->culled) {
+                    // past the cull distance the result is never picked, so the gradient of the bound is left out
+                    shaderCode += "float boundDist = " + resolveRelativeNodes(fragments[i]->boundExpr, i) + ";\n";
+                    shaderCode += variant == MAP ? "if (boundDist > cull) return SDFData(vec4(boundDist, 0.0, 0.0, 0.0), -1);\n"
+                        : variant == MAP_DIST ? "if (boundDist > cull) return boundDist;\n"
+                        : "if (boundDist > cull) return vec4(boundDist, 0.0, 0.0, 0.0);\n";
+                }
+                shaderCode += tmpDecl;
+                shaderCode += functionBodies[i];
+                shaderCode += "return res;\n}\n\n";
+            }
+        }
+        const std::string& rootExpr = variant == MAP ? rootFragment->expr : variant == MAP_DIST ? rootFragment->distExpr : rootFragment->gradExpr;
+        if (variant == MAP_GRAD) {
+            shaderCode += "#define MAP_GRAD\n";
+        }
+        shaderCode += variant == MAP ? m_shaderBegin : variant == MAP_DIST ? m_distShaderBegin : m_gradShaderBegin;
+        shaderCode += tmpDecl;
+        shaderCode += mapBody;
+        if (rootExpr.empty()) {
+            shaderCode += variant == MAP ? "return SDFData(vec4(1.0, 0.0, 0.0, 0.0), -1);}\n"
+                : variant == MAP_DIST ? "return 1.0;}\n"
+                : "return vec4(1.0, 0.0, 0.0, 0.0);}\n";
+        }
+        else {
+            shaderCode += "return ";
+            shaderCode += resolveRelativeNodes(rootExpr, count - 1);
+            shaderCode += ";\n}\n\n";
+        }
+    };
+    emitMap(MAP);
+    emitMap(MAP_DIST);
+    if (input.gradients) {
+        emitMap(MAP_GRAD);
+    }
+
+    // Keep the fragments of the previous generation around so undo/redo can reuse them
+    for (auto it = m_fragmentCache.begin(); it != m_fragmentCache.end();) {
+        if (it->second.lastUsed < m_codegenGeneration - 1) {
+            it = m_fragmentCache.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+	return shaderCode;
 }
 
 void Scene::newScene() {
@@ -21,12 +21,100 @@ struct SceneDescription {
     alignas(16) glm::vec4 outlineCol;
     alignas(4) int showGrid;
     alignas(4) int AA;
+    // camera of the frame drawn before, filled in by the engine for reprojecting its hits
+    alignas(16) glm::vec3 prev_camera_position;
+    alignas(16) glm::vec3 prev_camera_target;
+    alignas(4) float prev_camera_roll;
+    alignas(4) float prev_camera_fov;
+    alignas(4) int historyValid; // the bound previous history shows the same scene from that camera
+    alignas(4) int accumulatedSamples; // samples summed in the bound previous accumulation, 0 starts over
+    alignas(4) float lodDistance; // hits past this distance are shaded coarser, 0 turns it off
+    alignas(4) float lodFootprint; // hits where a pixel covers more than this are shaded coarser, 0 turns it off
+};
+
+// Generated GLSL for one node: statements emitted before use and the expression naming its SDFData
+struct ShaderFragment {
+    std::string code;
+    std::string expr;
+    std::string distCode; // same tree for mapDist(), floats only
+    std::string distExpr;
+    std::string gradCode; // same tree for mapGrad(), distance and gradient in a vec4
+    std::string gradExpr;
+    bool function = false; // group emitted as its own SDFData g<i>(vec3 pos), code is that function's body
+    bool culled = false; // function takes a cull distance from its parent and returns its bound distance beyond it
+    std::string boundExpr; // distance from pos to the bounding sphere of a culled group
+    std::string key; // full structural key, different keys can share a hash
+    int id = 0; // unique per key for the life of the cache, parents key on it instead of the child's key
+    int lastUsed = 0;
+};
+
+// Node list handed to codegen, either the edited scene or a synthetic benchmark scene
+struct ShaderCodegenInput {
+    const NodeData* nodes = nullptr;
+    int count = 0;
+    std::vector<std::string> shaderNames; // shape function per object node, empty for groups
+    std::vector<bool> live; // empty for uniform codegen, otherwise nodes that keep reading the node buffer
+    std::vector<int> bvhRoots; // per group, root of the hierarchy in the BVH buffer that replaces its subtree, or -1
+    std::vector<bool> liveBounds; // with live, nodes whose bound is read from the node buffer, the live nodes and their ancestors
+    std::vector<int> frozenVolumes; // per group, volume of the brick pool that replaces its subtree, or -1
+    std::vector<glm::vec4> frozenGrids; // per volume, corner in group local space and cell size
+    int groupFunctionMinNodes = 0;
+    bool boundsCulling = false;
+    bool gradients = false; // also emit mapGrad()
 };
 
 class Scene {
 
 public:
     static const int m_maxObjects = 101;
+    static const int m_maxInterpreterStack = 16; // MAX_STACK_SIZE in scene.comp
+
+    // Postfix program over the node buffer evaluated by scene.comp, one shape push per object, one combine
+    // per non-first child and one bound test per culled group, so it only changes with the structure of the scene
+    struct Bytecode {
+        alignas(16) glm::ivec4 header; // instruction count, stack depth, valid
+        alignas(16) glm::ivec4 code[3 * m_maxObjects]; // opcode, node index, parent index or jump target, shape function index
+    };
+
+    struct BvhNode {
+        alignas(16) glm::vec4 lo;
+        alignas(16) glm::vec4 hi;
+        alignas(16) glm::ivec4 links; // inner: left, right, 0; leaf: node index, shape function index, 1
+    };
+    // Bounding volume hierarchies over the objects of large union-only subtrees, one per subtree. A subtree of
+    // n objects owns a fixed range of 2n - 1 nodes so the generated code only depends on the structure of the scene.
+    struct Bvh {
+        alignas(16) glm::ivec4 header; // node count
+        BvhNode nodes[2 * m_maxObjects];
+    };
+
+    static const int m_maxFrozenVolumes = 8; // MAX_FROZEN_VOLUMES in definitions.comp
+    static const int m_frozenBricks = 8; // bricks per axis of a volume
+    static const int m_frozenCells = 8; // cells per axis of a brick
+    static const int m_maxFrozenBricks = 2048;
+    // Sparse distance volumes of frozen groups, only written by freeze.comp on the GPU. Bricks crossed by the
+    // surface hold (cells + 1)^3 samples in a shared pool, the others a single distance.
+    struct FrozenPool {
+        alignas(16) glm::ivec4 header; // used pool slots
+        glm::ivec2 bricks[m_maxFrozenVolumes * m_frozenBricks * m_frozenBricks * m_frozenBricks]; // pool slot or -1, coarse distance
+        uint32_t samples[m_maxFrozenBricks * (m_frozenCells + 1) * (m_frozenCells + 1) * (m_frozenCells + 1)]; // half distance, RGB565 color
+    };
+
+    static const int m_sceneGridSize = 64; // SCENE_GRID_SIZE in definitions.comp
+    static const int m_maxSceneGridSpheres = 64;
+    // Nodes changed since a frame's scene grid was last updated, a sphere around the old and the new extent of each
+    struct SceneGridUpdate {
+        alignas(16) glm::ivec4 header; // sphere count
+        glm::vec4 spheres[m_maxSceneGridSpheres];
+    };
+
+    static const int m_maxTiles = 131072; // MAX_TILES in definitions.comp, 8x8 pixel tiles of a 4096x2048 viewport
+    // Viewport tiles of every class found by the cone pass of render.comp, written on the GPU only.
+    // Each list comes with the indirect dispatch that draws it, as many workgroups as its pixels need.
+    struct TileLists {
+        glm::uvec4 dispatch[3]; // workgroups, 1, 1, tile count for empty, simple and complex tiles
+        uint32_t tiles[3 * m_maxTiles]; // x | y << 16
+    };
     Scene(glm::vec4 viewport);
     
     std::vector<BufferInitParams> buffers;
@@ -56,6 +144,7 @@ public:
     SceneGraphNode* GetSelectedNode();
     void updateNodeData(bool saveHistrory = true);
     std::array<NodeData, m_maxObjects> GetNodeData() { return m_nodeData; }
+    NodeData* GetNodeDataPtr() { return m_nodeData.data(); }
     Camera m_camera;
     void setCameraPosition(glm::vec3 pos) { m_camera.setPosition(pos); description.camera_position = pos; }
     void setCameraTarget(glm::vec3 target) { m_camera.LookAt(target); description.camera_target = target; }
@@ -65,6 +154,11 @@ public:
     void setSunPosition(glm::vec4 pos);
     float getOutlineThickness() { return m_outlineThickness; }
     void setOutlineThickness(float thickness);
+    // Shading LOD, AO, shadows and normals get coarser with distance and pixel footprint up to twice these
+    float getLodDistance() { return m_lodDistance; }
+    void setLodDistance(float distance);
+    float getLodFootprint() { return m_lodFootprint; }
+    void setLodFootprint(float footprint);
     glm::vec4 getOutlineColor() { return m_outlineColor; }
     void setOutlineColor(glm::vec4 color);
     void insertNodeAfter(SceneGraphNode* node, SceneGraphNode* moveBehindNode);
@@ -92,7 +186,38 @@ public:
     void endAction();
     SceneData CreateSnapshot(bool saveToHistory = true);
     void newScene();
-    std::string getShaderCode();
+    std::string getShaderCode(codegenMode mode = codegenMode::UNIFORM);
+    std::string getBenchmarkShaderCode(int nodeCount, int groupFunctionMinNodes, bool boundsCulling);
+    // Groups with at least this many nodes in their subtree get their own GLSL function, 0 emits a single flat map()
+    void setGroupFunctionMinNodes(int minNodes) { m_groupFunctionMinNodes = minNodes; needsRecompilation = true; }
+    int getGroupFunctionMinNodes() { return m_groupFunctionMinNodes; }
+    // Union groups skip their subtree when their bounding sphere is further than the distance they could still change
+    void setBoundsCulling(bool culling) { m_boundsCulling = culling; needsRecompilation = true; }
+    bool getBoundsCulling() { return m_boundsCulling; }
+    // Normals come from mapGrad(), the scene differentiated alongside its distance, instead of differences of mapDist()
+    void setAnalyticGradients(bool gradients) { m_analyticGradients = gradients; needsRecompilation = true; }
+    bool getAnalyticGradients() { return m_analyticGradients; }
+    std::vector<bool> getLiveNodes();
+    void updateBytecode();
+    void updateBvh();
+    Bvh* GetBvhPtr() { return &m_bvh; }
+    // Union-only subtrees with at least this many objects are traversed through a BVH, 0 disables it
+    void setBvhMinObjects(int minObjects) { m_bvhMinObjects = minObjects; needsRecompilation = true; }
+    int getBvhMinObjects() { return m_bvhMinObjects; }
+    bool isBytecodeValid() { return m_bytecode.header.z != 0; }
+    // A frozen group is drawn from a volume baked on the GPU, edits below it show up once it is unfrozen
+    bool freezeGroup(int id);
+    void unfreezeGroup(int id);
+    bool isFrozen(int id);
+    int getFrozenVolumeCount() { return int(m_frozenVolumes.size()); }
+    int getFrozenPoolBuffer() { return m_frozenPoolBuffer; }
+    int getTileBuffer() { return m_tileBuffer; }
+    std::string getFreezeShaderCode(int volume);
+    bool needsFreezeBake = false;
+    // Spheres around the nodes changed since the last call, returns whether the whole scene grid has to be rebuilt instead
+    bool takeSceneGridChanges(std::vector<glm::vec4>& spheres);
+    SceneGridUpdate* GetSceneGridUpdatePtr() { return &m_sceneGridUpdate; }
+    std::string getInterpreterShaderCode();
     bool needsRecompilation = false;
     int getSceneSize() { return m_sceneSize; }
     std::string getShaderByName(std::string name, Type type);
@@ -107,11 +232,14 @@ private:
     glm::vec4 m_sunPosition = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
     float m_outlineThickness = 0.0f;
     glm::vec4 m_outlineColor = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    float m_lodDistance = 8.0f;
+    float m_lodFootprint = 0.02f;
     bool m_shiftPressed = false;
     int m_tmpNodeIndex = 0;
     int m_deltaTime;
     std::string m_shaderBegin = "SDFData map(in vec3 pos) {\n";
-    std::string m_shaderCode;
+    std::string m_distShaderBegin = "float mapDist(in vec3 pos) {\n";
+    std::string m_gradShaderBegin = "vec4 mapGrad(in vec3 pos) {\n";
     std::vector<SceneGraphNode*> m_sceneGraphNodes;
     SceneGraphNode m_sceneGraph;
     SceneGraphNode m_copyNode;
@@ -120,9 +248,40 @@ private:
     int m_sceneSize = 0;
     int m_showGrid = 1;
     int m_AA = 1;
+    int m_groupFunctionMinNodes = 0;
+    bool m_boundsCulling = true;
+    bool m_analyticGradients = true;
+    int m_bvhMinObjects = 8;
+    static const int m_maxBvhSahDepth = 16; // median splits below, keeps the traversal stack in BVH_STACK_SIZE
+    static constexpr float m_unboundedRadius = 1e9f;
     std::array<NodeData, m_maxObjects> m_nodeData;
+    Bytecode m_bytecode = {};
+    Bvh m_bvh = {};
+    std::vector<int> m_bvhRoots;
+    bool m_bvhValid = false; // node indices in m_bvh still match m_nodeData, so it can be refit
+    struct BvhPrimitive {
+        int node;
+        int shape;
+        glm::vec3 lo;
+        glm::vec3 hi;
+    };
+    int buildBvh(std::vector<BvhPrimitive>& primitives, int begin, int end, int& nextNode, int depth);
+    void refitBvh();
+    std::map<std::pair<int, std::string>, int> getShapeFunctionIndices();
+    struct FrozenVolume {
+        int groupId;
+        glm::vec4 grid; // corner in group local space, cell size
+    };
+    std::vector<FrozenVolume> m_frozenVolumes;
+    int m_frozenPoolBuffer = -1; // index in buffers
+    int m_tileBuffer = -1; // index in buffers
+    SceneGridUpdate m_sceneGridUpdate = {}; // layout of the buffer only, every frame uploads its own changes
+    std::array<NodeData, m_maxObjects> m_sceneGridNodes; // nodes as of the last Update, to find the changed ones
+    std::vector<glm::vec4> m_sceneGridChanges;
+    bool m_sceneGridRebuild = true;
+    int getNodeIndex(int id);
     void SerializeNode(SceneGraphNode* node);
-    void AddBuffer(size_t size, vk::BufferUsageFlagBits usage, vk::DescriptorType descriptorType, void* dataPtr, bool hostVisible = false);
+    void AddBuffer(size_t size, vk::BufferUsageFlags usage, vk::DescriptorType descriptorType, void* dataPtr, bool hostVisible = false);
     void SetupObjects();
     bool m_isActionOngoing = false;
     SceneGraphNode* AddSceneGraphNode(std::string name);
@@ -133,7 +292,23 @@ private:
     static const int m_maxUndoRedo = 100;
     UndoStack undoStack = UndoStack(m_maxUndoRedo);
     UndoStack redoStack = UndoStack(m_maxUndoRedo);
-    std::string mirrirShader(std::string node, NodeData nodeData);
+    std::string mirrirShader(const NodeData* nodes, int parentIndex, NodeData nodeData, bool baked, bool grad = false);
     void InitShapes();
-    std::string getAllShapesCode();
+    std::map<std::string, std::string> m_builtinShapeCode; // library code per shape name, edited shapes have no known extent
+    std::set<std::pair<Type, std::string>> m_libraryShapes; // shapes whose code is still the library code
+    void updateLibraryShapes(); // after any change to the shape code
+    std::vector<std::string> getShaderNames();
+    float shapeBoundingRadius(const NodeData& node, const std::string& shaderName);
+    void computeBounds(NodeData* nodes, int count, const std::vector<std::string>& shaderNames);
+    std::string getUsedShapesCode(const std::vector<std::string>& shaderNames);
+    std::set<std::string> m_emittedShapes; // last selection getUsedShapesCode logged
+    // <shape>Grad() for each shape, analytic for unedited library shapes and differences of the shape otherwise
+    std::string getShapeGradientCode(const std::vector<std::pair<Type, std::string>>& shapes);
+    // Subtree cached codegen, keyed by the structure of each node and its children, node names in the text are relative
+    std::unordered_multimap<size_t, ShaderFragment> m_fragmentCache;
+    int m_codegenGeneration = 0;
+    int m_nextFragmentId = 0;
+    std::string nodeStructureKey(const ShaderCodegenInput& input, int index, const std::vector<const ShaderFragment*>& fragments, bool asFunction, bool culled);
+    ShaderFragment emitNodeFragment(const ShaderCodegenInput& input, int index, const std::vector<const ShaderFragment*>& fragments, bool asFunction, bool culled);
+    std::string generateShaderCode(const ShaderCodegenInput& input);
 };
@@ -17,6 +17,8 @@ struct SceneData {
     float outlineThickness;
     glm::vec4 outlineColor;
     std::map<Type, std::vector<ShaderShape>> shaderShapes;
+    float lodDistance = 8.0f;
+    float lodFootprint = 0.02f;
 
     bool operator==(const SceneData& other) const {
         return sceneSize == other.sceneSize &&
@@ -28,6 +30,8 @@ struct SceneData {
             sunPosition == other.sunPosition &&
             outlineThickness == other.outlineThickness &&
             outlineColor == other.outlineColor &&
+            lodDistance == other.lodDistance &&
+            lodFootprint == other.lodFootprint &&
             names == other.names;
             shaderShapes == other.shaderShapes;
     }
@@ -35,6 +39,12 @@ struct SceneData {
     template <class Archive>
     void serialize(Archive& archive) {
         archive(nodeData, names, sceneSize, showGrid, AA, selectedId, backgroundColor, sunPosition, outlineThickness, outlineColor, shaderShapes);
+        // Added later, scenes saved before end here and keep the defaults
+        try {
+            archive(lodDistance, lodFootprint);
+        }
+        catch (cereal::Exception&) {
+        }
     }
 };
 
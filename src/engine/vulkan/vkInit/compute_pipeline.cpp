@@ -29,7 +29,7 @@ void vkInit::ComputePipelineBuilder::reset_shader_modules() {
 	}
 }
 
-void vkInit::ComputePipelineBuilder::specify_compute_shader(const char* filename) {
+void vkInit::ComputePipelineBuilder::specify_compute_shader(const char* filename, UINT tail) {
 
 	if (m_computeShader) {
         m_device.destroyShaderModule(m_computeShader);
@@ -37,7 +37,7 @@ void vkInit::ComputePipelineBuilder::specify_compute_shader(const char* filename
 	}
 
 	vkLogging::Logger::get_logger()->print("Create compute shader module");
-    m_computeShader = vkUtil::createModule(filename, m_device); 
+    m_computeShader = vkUtil::createModule(filename, m_device, tail);
     m_computeShaderInfo = make_shader_info(m_computeShader, vk::ShaderStageFlagBits::eCompute);
 }
 
@@ -60,9 +60,32 @@ void vkInit::ComputePipelineBuilder::reset_descriptor_set_layouts() {
     m_descriptorSetLayouts.clear();
 }
 
+void vkInit::ComputePipelineBuilder::set_pipeline_cache(vk::PipelineCache pipelineCache) {
+    m_pipelineCache = pipelineCache;
+}
+
+void vkInit::ComputePipelineBuilder::set_render_quality(const vkUtil::RenderQuality& quality) {
+    m_renderQuality = quality;
+}
+
+void vkInit::ComputePipelineBuilder::set_workgroup_size(glm::uvec2 size) {
+    m_workgroupSize = size;
+}
+
+void vkInit::ComputePipelineBuilder::set_creation_feedback(bool enabled) {
+    m_creationFeedback = enabled;
+}
+
 vkInit::ComputePipelineOutBundle vkInit::ComputePipelineBuilder::build() {
 
 	//Compute Shader
+    m_renderQuality.localSizeX = m_workgroupSize.x;
+    m_renderQuality.localSizeY = m_workgroupSize.y;
+    m_specializationInfo.mapEntryCount = static_cast<uint32_t>(m_specializationEntries.size());
+    m_specializationInfo.pMapEntries = m_specializationEntries.data();
+    m_specializationInfo.dataSize = sizeof(m_renderQuality);
+    m_specializationInfo.pData = &m_renderQuality;
+    m_computeShaderInfo.pSpecializationInfo = &m_specializationInfo;
     m_pipelineInfo.stage = m_computeShaderInfo;
 
 	//Pipeline Layout
@@ -73,16 +96,30 @@ vkInit::ComputePipelineOutBundle vkInit::ComputePipelineBuilder::build() {
 	//Make the Pipeline
 	vkLogging::Logger::get_logger()->print("Create Compute Pipeline");
 	vk::Pipeline computePipeline;
+	vk::PipelineCreationFeedback creationFeedback = {};
+	vk::PipelineCreationFeedbackCreateInfo feedbackInfo = {};
+	feedbackInfo.pPipelineCreationFeedback = &creationFeedback;
+	m_pipelineInfo.pNext = m_creationFeedback ? &feedbackInfo : nullptr;
 	try {
-        computePipeline = (m_device.createComputePipeline(nullptr, m_pipelineInfo)).value;
+        computePipeline = (m_device.createComputePipeline(m_pipelineCache, m_pipelineInfo)).value;
 	}
 	catch (vk::SystemError err) {
 		vkLogging::Logger::get_logger()->print("Failed to create Pipeline");
 	}
+	m_pipelineInfo.pNext = nullptr;
+
+	if (creationFeedback.flags & vk::PipelineCreationFeedbackFlagBits::eValid) {
+		bool cacheHit = static_cast<bool>(creationFeedback.flags & vk::PipelineCreationFeedbackFlagBits::eApplicationPipelineCacheHit);
+		std::stringstream message;
+		message << "Compute pipeline created in " << creationFeedback.duration / 1000000.0 << " ms"
+			<< (cacheHit ? " (pipeline cache hit)" : " (pipeline cache miss)");
+		vkLogging::Logger::get_logger()->print(message.str());
+	}
 
 	ComputePipelineOutBundle output;
 	output.layout = pipelineLayout;
 	output.pipeline = computePipeline;
+	output.quality = m_renderQuality;
 
 	return output;
 }
@@ -107,7 +144,9 @@ vk::PipelineLayout vkInit::ComputePipelineBuilder::make_pipeline_layout() {
 	layoutInfo.setLayoutCount = static_cast<uint32_t>(m_descriptorSetLayouts.size());
 	layoutInfo.pSetLayouts = m_descriptorSetLayouts.data();
 
-	layoutInfo.pushConstantRangeCount = 0;
+	vk::PushConstantRange passRange(vk::ShaderStageFlagBits::eCompute, 0, sizeof(vkUtil::PassConstants));
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &passRange;
 
 	try {
 		return m_device.createPipelineLayout(layoutInfo);
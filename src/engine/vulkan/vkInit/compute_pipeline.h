@@ -12,6 +12,7 @@ namespace vkInit {
 	struct ComputePipelineOutBundle {
 		vk::PipelineLayout layout;
 		vk::Pipeline pipeline;
+		vkUtil::RenderQuality quality; // constants the pipeline was specialized with
 	};
 
 	class ComputePipelineBuilder {
@@ -24,7 +25,11 @@ namespace vkInit {
 
 		void reset();
 
-		void specify_compute_shader(const char* filename);
+		/**
+			\param filename the generated scene code placed between the shared shaders and main()
+			\param tail the shader resource holding main()
+		*/
+		void specify_compute_shader(const char* filename, UINT tail = IDR_SHADER_RENDER);
 
 		/**
 			Make a graphics pipeline, along with renderpass and pipeline layout
@@ -38,9 +43,46 @@ namespace vkInit {
 
 		void reset_descriptor_set_layouts();
 
+		/**
+			Use the given pipeline cache for every pipeline built from now on.
+
+			\param pipelineCache the cache shared by all compute pipelines
+		*/
+		void set_pipeline_cache(vk::PipelineCache pipelineCache);
+
+		/**
+			Specialize render.comp for every pipeline built from now on,
+			the interactive tier is used until this is called.
+
+			\param quality the constants of the wanted quality tier
+		*/
+		void set_render_quality(const vkUtil::RenderQuality& quality);
+
+		/**
+			Specialize the workgroup shape of every pipeline built from now on,
+			whatever the quality tier, 8x8 until this is called.
+
+			\param size local size in x and y, local size in z is 1
+		*/
+		void set_workgroup_size(glm::uvec2 size);
+
+		/**
+			Report the creation time and pipeline cache hit of every pipeline built from now on,
+			off until this is called.
+
+			\param enabled whether the device supports pipeline creation feedback
+		*/
+		void set_creation_feedback(bool enabled);
+
 	private:
 		vk::Device m_device;
 		vk::ComputePipelineCreateInfo m_pipelineInfo = {};
+		vk::PipelineCache m_pipelineCache = nullptr;
+		vkUtil::RenderQuality m_renderQuality = vkUtil::get_render_quality(qualityTier::INTERACTIVE);
+		glm::uvec2 m_workgroupSize = glm::uvec2(8, 8);
+		bool m_creationFeedback = false;
+		std::vector<vk::SpecializationMapEntry> m_specializationEntries = vkUtil::render_quality_map_entries();
+		vk::SpecializationInfo m_specializationInfo;
 
 		vk::ShaderModule m_computeShader = nullptr;
 		vk::PipelineShaderStageCreateInfo m_computeShaderInfo;
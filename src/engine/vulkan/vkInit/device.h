@@ -50,6 +50,29 @@ namespace vkInit {
 		return requiredExtensions.empty();
 	}
 
+	/**
+		Check whether pipeline creation feedback is core for the device,
+		the lower of the instance and device versions counts.
+
+		\param device the physical device
+		\returns whether the device runs Vulkan 1.3 or later
+	*/
+	bool has_core_creation_feedback(const vk::PhysicalDevice& device) {
+		return std::min(vk::enumerateInstanceVersion(), device.getProperties().apiVersion) >= VK_API_VERSION_1_3;
+	}
+
+	/**
+		Check whether pipeline creation feedback can be chained into pipeline creation,
+		either as core or through VK_EXT_pipeline_creation_feedback, which create_logical_device enables.
+
+		\param device the physical device
+		\returns whether the logical device will accept the feedback struct
+	*/
+	bool supports_creation_feedback(const vk::PhysicalDevice& device) {
+		return has_core_creation_feedback(device)
+			|| checkDeviceExtensionSupport(device, { VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME });
+	}
+
 	/**
 		Check whether the given physical device is suitable for use.
 
@@ -194,6 +217,9 @@ namespace vkInit {
 		std::vector<const char*> deviceExtensions = {
 			VK_KHR_SWAPCHAIN_EXTENSION_NAME
 		};
+		if (!has_core_creation_feedback(physicalDevice) && supports_creation_feedback(physicalDevice)) {
+			deviceExtensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+		}
 
 		std::vector<const char*> enabledLayers;
 		if (vkLogging::Logger::get_logger()->get_debug_mode()) {
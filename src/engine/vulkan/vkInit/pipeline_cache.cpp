@@ -0,0 +1,102 @@
+#include "pipeline_cache.h"
+#include "../../logging.h"
+
+namespace {
+	const uint32_t cacheFileMagic = 0x43504B56; // "VKPC"
+
+	// Written in front of the driver's own blob, the blob header alone does not carry the driver version
+	struct PipelineCacheFileHeader {
+		uint32_t magic;
+		uint32_t driverVersion;
+		uint64_t dataSize;
+	};
+
+	bool is_cache_compatible(const std::vector<char>& data, const vk::PhysicalDeviceProperties& properties) {
+		if (data.size() < sizeof(VkPipelineCacheHeaderVersionOne)) {
+			return false;
+		}
+		VkPipelineCacheHeaderVersionOne header;
+		std::memcpy(&header, data.data(), sizeof(header));
+		return header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+			&& header.vendorID == properties.vendorID
+			&& header.deviceID == properties.deviceID
+			&& std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+}
+
+vk::PipelineCache vkInit::make_pipeline_cache(
+	vk::Device device, vk::PhysicalDevice physicalDevice, const std::string& filename) {
+
+	vk::PhysicalDeviceProperties properties = physicalDevice.getProperties();
+	std::vector<char> data;
+
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (file.is_open()) {
+		uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+		file.seekg(0);
+		PipelineCacheFileHeader fileHeader = {};
+		file.read(reinterpret_cast<char*>(&fileHeader), sizeof(fileHeader));
+		// a truncated or corrupt file must not size the allocation
+		if (file && fileHeader.magic == cacheFileMagic && fileHeader.driverVersion == properties.driverVersion
+			&& fileHeader.dataSize <= fileSize - sizeof(fileHeader)) {
+			data.resize(fileHeader.dataSize);
+			file.read(data.data(), fileHeader.dataSize);
+			if (!file || !is_cache_compatible(data, properties)) {
+				data.clear();
+			}
+		}
+		file.close();
+
+		if (data.empty()) {
+			vkLogging::Logger::get_logger()->print("Pipeline cache on disk does not match this device or driver, starting empty");
+		}
+	}
+
+	vk::PipelineCacheCreateInfo cacheInfo = {};
+	cacheInfo.flags = vk::PipelineCacheCreateFlags();
+	cacheInfo.initialDataSize = data.size();
+	cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+	try {
+		vk::PipelineCache pipelineCache = device.createPipelineCache(cacheInfo);
+		std::stringstream message;
+		message << "Created pipeline cache with " << data.size() << " bytes of saved data";
+		vkLogging::Logger::get_logger()->print(message.str());
+		return pipelineCache;
+	}
+	catch (vk::SystemError err) {
+		vkLogging::Logger::get_logger()->print("Failed to create pipeline cache");
+		return nullptr;
+	}
+}
+
+void vkInit::save_pipeline_cache(
+	vk::Device device, vk::PhysicalDevice physicalDevice, vk::PipelineCache pipelineCache, const std::string& filename) {
+
+	if (!pipelineCache) {
+		return;
+	}
+
+	std::vector<uint8_t> data = device.getPipelineCacheData(pipelineCache);
+	if (data.empty()) {
+		return;
+	}
+
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		vkLogging::Logger::get_logger()->print("Failed to write pipeline cache");
+		return;
+	}
+
+	PipelineCacheFileHeader fileHeader = {};
+	fileHeader.magic = cacheFileMagic;
+	fileHeader.driverVersion = physicalDevice.getProperties().driverVersion;
+	fileHeader.dataSize = data.size();
+	file.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+	file.write(reinterpret_cast<const char*>(data.data()), data.size());
+	file.close();
+
+	std::stringstream message;
+	message << "Saved " << data.size() << " bytes of pipeline cache data";
+	vkLogging::Logger::get_logger()->print(message.str());
+}
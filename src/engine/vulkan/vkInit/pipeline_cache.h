@@ -0,0 +1,28 @@
+#pragma once
+#include "../../../common/config.h"
+
+namespace vkInit {
+
+	/**
+		Make a pipeline cache, seeded with the data saved by a previous session
+		when it was written by the same device and driver.
+
+		\param device the logical device
+		\param physicalDevice the physical device the cache data must match
+		\param filename path of the saved cache data
+		\returns the created pipeline cache
+	*/
+	vk::PipelineCache make_pipeline_cache(
+		vk::Device device, vk::PhysicalDevice physicalDevice, const std::string& filename);
+
+	/**
+		Write the contents of a pipeline cache to disk.
+
+		\param device the logical device
+		\param physicalDevice the physical device, its driver version is stored with the data
+		\param pipelineCache the cache to serialize
+		\param filename path to write the cache data to
+	*/
+	void save_pipeline_cache(
+		vk::Device device, vk::PhysicalDevice physicalDevice, vk::PipelineCache pipelineCache, const std::string& filename);
+}
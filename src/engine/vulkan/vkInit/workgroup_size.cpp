@@ -0,0 +1,67 @@
+#include "workgroup_size.h"
+#include "../../logging.h"
+#include <iomanip>
+
+namespace {
+	std::string device_key(vk::PhysicalDevice physicalDevice) {
+		auto properties = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceIDProperties>();
+		const vk::PhysicalDeviceIDProperties& id = properties.get<vk::PhysicalDeviceIDProperties>();
+		std::stringstream key;
+		key << std::hex << std::setfill('0');
+		for (uint32_t i = 0; i < VK_UUID_SIZE; i++) {
+			key << std::setw(2) << static_cast<uint32_t>(id.deviceUUID[i]);
+		}
+		return key.str();
+	}
+}
+
+bool vkInit::load_workgroup_size(
+	vk::PhysicalDevice physicalDevice, const std::string& filename, glm::uvec2& size) {
+
+	std::ifstream file(filename);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	std::string key = device_key(physicalDevice);
+	std::string line;
+	while (std::getline(file, line)) {
+		std::stringstream fields(line);
+		std::string lineKey;
+		glm::uvec2 lineSize;
+		if (fields >> lineKey >> lineSize.x >> lineSize.y && lineKey == key && lineSize.x > 0 && lineSize.y > 0) {
+			size = lineSize;
+			std::stringstream message;
+			message << "Using saved workgroup size " << size.x << "x" << size.y;
+			vkLogging::Logger::get_logger()->print(message.str());
+			return true;
+		}
+	}
+	return false;
+}
+
+void vkInit::save_workgroup_size(
+	vk::PhysicalDevice physicalDevice, const std::string& filename, glm::uvec2 size) {
+
+	std::string key = device_key(physicalDevice);
+	std::vector<std::string> lines;
+	std::ifstream in(filename);
+	std::string line;
+	while (std::getline(in, line)) {
+		if (!line.empty() && line.compare(0, key.size(), key) != 0) {
+			lines.push_back(line);
+		}
+	}
+	in.close();
+
+	std::ofstream file(filename, std::ios::trunc);
+	if (!file.is_open()) {
+		vkLogging::Logger::get_logger()->print("Failed to write workgroup size");
+		return;
+	}
+	for (const std::string& other : lines) {
+		file << other << "\n";
+	}
+	file << key << " " << size.x << " " << size.y << "\n";
+	file.close();
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "../../../common/config.h"
+
+namespace vkInit {
+
+	/**
+		Read the workgroup shape tuned for a device by a previous session.
+
+		\param physicalDevice the physical device, looked up by its UUID
+		\param filename path of the saved shapes, one line per device
+		\param size receives the saved shape when the device has one
+		\returns whether the device has a saved shape
+	*/
+	bool load_workgroup_size(
+		vk::PhysicalDevice physicalDevice, const std::string& filename, glm::uvec2& size);
+
+	/**
+		Save the workgroup shape tuned for a device, the lines of other devices are kept.
+
+		\param physicalDevice the physical device, its UUID keys the line
+		\param filename path of the saved shapes
+		\param size the shape to save
+	*/
+	void save_workgroup_size(
+		vk::PhysicalDevice physicalDevice, const std::string& filename, glm::uvec2 size);
+}
@@ -24,7 +24,7 @@ private:
 
 struct BufferInitParams {
     size_t size;
-    vk::BufferUsageFlagBits usage;
+    vk::BufferUsageFlags usage;
     vk::DescriptorType descriptorType;
     void* dataPtr = nullptr;
 	bool hostVisible = false;
@@ -24,6 +24,48 @@ void vkUtil::SwapChainFrame::AddBuffers(const std::vector<BufferInitParams>& buf
     }
 }
 
+void vkUtil::SwapChainFrame::AddImages(const std::vector<FrameImageParams>& imageParams, vk::Device logicalDevice, vk::PhysicalDevice physicalDevice)
+{
+	uint32_t binding = static_cast<uint32_t>(bufferSetups.size()) + 1;
+	for (const auto& params : imageParams) {
+		FrameImage frameImage;
+		frameImage.width = (width + params.divisor - 1) / params.divisor;
+		frameImage.height = (height + params.divisor - 1) / params.divisor;
+		frameImage.dstBinding = binding++;
+		frameImage.previous = params.previous;
+		if (params.previous >= 0) {
+			// until the engine knows another frame, this frame's own image
+			frameImage.image = nullptr;
+			frameImage.memory = nullptr;
+			frameImage.view = images[params.previous].view;
+			frameImage.descriptor = images[params.previous].descriptor;
+			images.push_back(frameImage);
+			continue;
+		}
+
+		vkImage::ImageInputChunk input;
+		input.logicalDevice = logicalDevice;
+		input.physicalDevice = physicalDevice;
+		input.width = frameImage.width;
+		input.height = frameImage.height;
+		input.format = params.format;
+		input.arrayCount = 1;
+		input.tiling = vk::ImageTiling::eOptimal;
+		input.usage = vk::ImageUsageFlagBits::eStorage;
+		input.memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal;
+		frameImage.image = vkImage::make_image(input);
+		frameImage.memory = vkImage::make_image_memory(input, frameImage.image);
+		frameImage.view = vkImage::make_image_view(
+			logicalDevice, frameImage.image, params.format,
+			vk::ImageAspectFlagBits::eColor, vk::ImageViewType::e2D, 1);
+
+		frameImage.descriptor.imageLayout = vk::ImageLayout::eGeneral;
+		frameImage.descriptor.imageView = frameImage.view;
+		frameImage.descriptor.sampler = nullptr;
+		images.push_back(frameImage);
+	}
+}
+
 void vkUtil::SwapChainFrame::make_descriptor_resources(vk::Device logicalDevice, vk::PhysicalDevice physicalDevice) {
 	
 	colorBufferDescriptor.imageLayout = vk::ImageLayout::eGeneral;
@@ -54,6 +96,17 @@ void vkUtil::SwapChainFrame::record_write_operations() {
         bufferOp.pBufferInfo = &bufferSetup.buffer.descriptor;
         writeOps.push_back(bufferOp);
     }
+
+	for (auto& frameImage : images) {
+		vk::WriteDescriptorSet imageOp;
+		imageOp.dstSet = descriptorSet[pipelineType::COMPUTE];
+		imageOp.dstBinding = frameImage.dstBinding;
+		imageOp.dstArrayElement = 0;
+		imageOp.descriptorCount = 1;
+		imageOp.descriptorType = vk::DescriptorType::eStorageImage;
+		imageOp.pImageInfo = &frameImage.descriptor;
+		writeOps.push_back(imageOp);
+	}
 }
 
 void vkUtil::SwapChainFrame::write_descriptor_set() {
@@ -69,6 +122,15 @@ void vkUtil::SwapChainFrame::destroy() {
     for (auto& bufferSetup : bufferSetups) {
         bufferSetup.buffer.destroy(logicalDevice);
     }
+	for (auto& frameImage : images) {
+		if (frameImage.previous >= 0) {
+			continue;
+		}
+		logicalDevice.destroyImageView(frameImage.view);
+		logicalDevice.destroyImage(frameImage.image);
+		logicalDevice.freeMemory(frameImage.memory);
+	}
+	images.clear();
 }
 
 VkRenderingInfo vkUtil::rendering_info(VkExtent2D swapchainExtent, VkRenderingAttachmentInfo* colorAttachment, VkRenderingAttachmentInfo* depthAttachment) {
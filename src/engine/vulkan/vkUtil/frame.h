@@ -5,6 +5,25 @@
 
 namespace vkUtil {
 
+	/**
+		A storage image every frame owns, bound after the scene buffers
+	*/
+	struct FrameImageParams {
+		vk::Format format;
+		uint32_t divisor; // of the frame size, rounded up
+		int previous = -1; // no image of its own, the engine binds image \p previous of another frame
+	};
+
+	struct FrameImage {
+		vk::Image image;
+		vk::DeviceMemory memory;
+		vk::ImageView view;
+		vk::DescriptorImageInfo descriptor;
+		uint32_t dstBinding;
+		uint32_t width, height;
+		int previous = -1;
+	};
+
 	/**
 		Holds the data structures associated with a "Frame"
 	*/
@@ -29,6 +48,7 @@ namespace vkUtil {
 
 		//Resources
         std::vector<BufferSetup> bufferSetups;
+		std::vector<FrameImage> images; // in general layout once the engine has transitioned them
         
 
 		//Resource Descriptors
@@ -47,6 +67,13 @@ namespace vkUtil {
         
         void AddBuffers(const std::vector<BufferInitParams>& bufferParams, vk::Device logicalDevice, vk::PhysicalDevice physicalDevice);
 
+		/**
+			Create the frame's storage images, bound from the binding after the last buffer
+
+			\param imageParams format and size of each image
+		*/
+		void AddImages(const std::vector<FrameImageParams>& imageParams, vk::Device logicalDevice, vk::PhysicalDevice physicalDevice);
+
 		void make_descriptor_resources(vk::Device logicalDevice, vk::PhysicalDevice physicalDevice);
 
 		void record_write_operations();
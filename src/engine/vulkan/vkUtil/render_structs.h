@@ -9,4 +9,84 @@ namespace vkUtil {
 	struct ObjectData {
 		glm::mat4 model;
 	};
+
+	/**
+		Specialization constants of render.comp, in constant_id order
+	*/
+	struct RenderQuality {
+		int32_t marchSteps;
+		float hitEpsilon;
+		int32_t shadowSteps;
+		int32_t aoSamples;
+		int32_t normalTaps;
+		int32_t aaSamples; // 0 reads the AA setting from the scene buffer
+		vk::Bool32 showGrid;
+		vk::Bool32 picking;
+		vk::Bool32 offscreen;
+		vk::Bool32 sceneGrid; // march through the frame's scene grid, which only describes the edited scene
+		vk::Bool32 conePrepass; // start viewport rays at the depth of the frame's cone pass
+		vk::Bool32 reprojection; // start viewport rays near the hits of the frame drawn before
+		vk::Bool32 accumulate; // one jittered sample per frame added to the sum of the frame drawn before, instead of AA
+		vk::Bool32 tileClasses; // classify viewport tiles in the cone pass and record the steps they take
+		uint32_t localSizeX; // workgroup shape, see ComputePipelineBuilder::set_workgroup_size
+		uint32_t localSizeY;
+		vk::Bool32 splitShading; // the render pass leaves its hits in the G-buffer to a separate shading pass, needs accumulate
+		int32_t lightingScale; // 2 or 4 computes AO and sun shadow for one pixel per square of that size, needs split shading
+		float shadingLodMax; // how far distant hits may coarsen AO, shadows and normals, 0 shades every hit in full
+	};
+
+	/**
+		Push constants of render.comp
+	*/
+	struct PassConstants {
+		int32_t mode; // passMode
+		vk::Bool32 rebuild; // scene grid pass: every cell, not only the ones near a changed node; cone pass: fill Scene::TileLists
+		int32_t tiles; // render pass: tileClass
+	};
+
+	/**
+		\param tier the named quality level
+		\param aaSamples antialiasing used by tiers that do not fix their own
+		\returns the constants render.comp is specialized with for that tier
+	*/
+	inline RenderQuality get_render_quality(qualityTier tier, int32_t aaSamples = 0) {
+		switch (tier) {
+		case qualityTier::PREVIEW:
+			return { 256, 0.0005f, 12, 5, 4, aaSamples, VK_TRUE, VK_TRUE, VK_FALSE, VK_TRUE, VK_TRUE, VK_TRUE, VK_TRUE, VK_TRUE, 8, 8, VK_TRUE, 2, 0.5f };
+		case qualityTier::FINAL:
+			return { 256, 0.0005f, 36, 5, 8, 8, VK_FALSE, VK_FALSE, VK_TRUE, VK_FALSE, VK_FALSE, VK_FALSE, VK_FALSE, VK_FALSE, 8, 8, VK_FALSE, 1, 0.0f };
+		default:
+			return { 256, 0.0005f, 12, 5, 4, 0, VK_TRUE, VK_TRUE, VK_FALSE, VK_TRUE, VK_TRUE, VK_TRUE, VK_TRUE, VK_TRUE, 8, 8, VK_TRUE, 4, 1.0f };
+		}
+	}
+
+	/**
+		\returns map entries describing RenderQuality as specialization data
+	*/
+	inline std::vector<vk::SpecializationMapEntry> render_quality_map_entries() {
+		std::vector<vk::SpecializationMapEntry> entries;
+		auto add = [&](uint32_t offset, size_t size) {
+			entries.push_back(vk::SpecializationMapEntry(static_cast<uint32_t>(entries.size()), offset, size));
+		};
+		add(offsetof(RenderQuality, marchSteps), sizeof(int32_t));
+		add(offsetof(RenderQuality, hitEpsilon), sizeof(float));
+		add(offsetof(RenderQuality, shadowSteps), sizeof(int32_t));
+		add(offsetof(RenderQuality, aoSamples), sizeof(int32_t));
+		add(offsetof(RenderQuality, normalTaps), sizeof(int32_t));
+		add(offsetof(RenderQuality, aaSamples), sizeof(int32_t));
+		add(offsetof(RenderQuality, showGrid), sizeof(vk::Bool32));
+		add(offsetof(RenderQuality, picking), sizeof(vk::Bool32));
+		add(offsetof(RenderQuality, offscreen), sizeof(vk::Bool32));
+		add(offsetof(RenderQuality, sceneGrid), sizeof(vk::Bool32));
+		add(offsetof(RenderQuality, conePrepass), sizeof(vk::Bool32));
+		add(offsetof(RenderQuality, reprojection), sizeof(vk::Bool32));
+		add(offsetof(RenderQuality, accumulate), sizeof(vk::Bool32));
+		add(offsetof(RenderQuality, tileClasses), sizeof(vk::Bool32));
+		add(offsetof(RenderQuality, localSizeX), sizeof(uint32_t));
+		add(offsetof(RenderQuality, localSizeY), sizeof(uint32_t));
+		add(offsetof(RenderQuality, splitShading), sizeof(vk::Bool32));
+		add(offsetof(RenderQuality, lightingScale), sizeof(int32_t));
+		add(offsetof(RenderQuality, shadingLodMax), sizeof(float));
+		return entries;
+	}
 }
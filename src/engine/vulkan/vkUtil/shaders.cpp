@@ -1,7 +1,10 @@
 #pragma once
 #include "shaders.h"
+#include "spirv_cache.h"
 #include "../../logging.h"
 #include "glslang/Public/ShaderLang.h"
+#include "glslang/build_info.h"
+#include <chrono>
 
 #if defined(__APPLE__)
     #include <mach-o/dyld.h>
@@ -12,6 +15,22 @@
     #include <windows.h>
 #endif
 
+namespace {
+    // Fixed glslang settings, together with the glslang version they select the SPIR-V that comes out
+    const glslang_target_client_version_t clientVersion = GLSLANG_TARGET_VULKAN_1_3;
+    const glslang_target_language_version_t spirvVersion = GLSLANG_TARGET_SPV_1_3;
+    const glslang_messages_t compileMessages = GLSLANG_MSG_DEFAULT_BIT;
+    const int linkMessages = GLSLANG_MSG_SPV_RULES_BIT | GLSLANG_MSG_VULKAN_RULES_BIT;
+
+    std::string compilerOptions(glslang_stage_t stage) {
+        std::stringstream options;
+        options << "glslang " << GLSLANG_VERSION_MAJOR << "." << GLSLANG_VERSION_MINOR << "." << GLSLANG_VERSION_PATCH << GLSLANG_VERSION_FLAVOR
+            << " stage " << stage << " client " << clientVersion << " spirv " << spirvVersion
+            << " messages " << compileMessages << " " << linkMessages;
+        return options.str();
+    }
+}
+
 glslang_resource_t vkUtil::get_default_resource() {
     glslang_resource_t r = {
         /* .MaxLights = */ 32,
@@ -210,15 +229,15 @@ std::vector<uint32_t> vkUtil::compileShaderSourceToSpirv(std::string& shaderSour
     input.language = GLSLANG_SOURCE_GLSL;
     input.stage = shaderStage;
     input.client = GLSLANG_CLIENT_VULKAN;
-    input.client_version = GLSLANG_TARGET_VULKAN_1_3;
+    input.client_version = clientVersion;
     input.target_language = GLSLANG_TARGET_SPV;
-    input.target_language_version = GLSLANG_TARGET_SPV_1_3;
+    input.target_language_version = spirvVersion;
     input.code = shaderCode;
     input.default_version = 100;
     input.default_profile = GLSLANG_ES_PROFILE;
     input.force_default_version_and_profile = false;
     input.forward_compatible = false;
-    input.messages = GLSLANG_MSG_DEFAULT_BIT;
+    input.messages = compileMessages;
     input.resource = &defaultResources;
      
     glslang_shader_t* shader = glslang_shader_create(&input);
@@ -261,7 +280,7 @@ std::vector<uint32_t> vkUtil::compileShaderSourceToSpirv(std::string& shaderSour
     glslang_program_t* program = glslang_program_create();
     glslang_program_add_shader(program, shader);
 
-    if (!glslang_program_link(program, GLSLANG_MSG_SPV_RULES_BIT | GLSLANG_MSG_VULKAN_RULES_BIT))
+    if (!glslang_program_link(program, linkMessages))
     {
         std::cout << "\nERROR:   Failed to link shader[" << inputFilename << "] of kind["
                   << "\n         Log[" << glslang_shader_get_info_log(shader) << "]"
@@ -291,26 +310,42 @@ std::vector<char> vkUtil::prepareShader() {
     std::vector<char> shader = LoadShaderResource(IDR_SHADER_DEF);
     auto tmp = LoadShaderResource(IDR_SHADER_CSG);
     shader.insert(shader.end(), tmp.begin(), tmp.end());
+    tmp = LoadShaderResource(IDR_SHADER_FROZEN);
+    shader.insert(shader.end(), tmp.begin(), tmp.end());
     
     return shader;
 }
 
-std::vector<char> vkUtil::endShader(bool useForOut) {
-    return LoadShaderResource((useForOut) ? IDR_SHADER_RENDEROUT : IDR_SHADER_RENDER);
+std::vector<char> vkUtil::endShader(UINT tail) {
+    return LoadShaderResource(tail);
+}
+
+std::string vkUtil::assembleShaderSource(const std::string& shaderCode, UINT tail) {
+    std::vector<char> sourceCode = prepareShader();
+    sourceCode.insert(sourceCode.end(), shaderCode.begin(), shaderCode.end());
+    std::vector<char> tmp = endShader(tail);
+    sourceCode.insert(sourceCode.end(), tmp.begin(), tmp.end());
+    return std::string(sourceCode.begin(), sourceCode.end());
 }
 
-vk::ShaderModule vkUtil::createModule(std::string shaderCode, vk::Device device, bool useForOut) {
+vk::ShaderModule vkUtil::createModule(std::string shaderCode, vk::Device device, UINT tail) {
 
     vk::ShaderModuleCreateInfo moduleInfo = {};
     moduleInfo.flags = vk::ShaderModuleCreateFlags();
-    std::vector<char> sourceCode = prepareShader();
-    std::vector<char> tmp(shaderCode.begin(), shaderCode.end());
-    sourceCode.insert(sourceCode.end(), tmp.begin(), tmp.end());
-    tmp = endShader(useForOut);
-    sourceCode.insert(sourceCode.end(), tmp.begin(), tmp.end());
-    
-    std::string str(sourceCode.begin(), sourceCode.end());
-    auto sourceCodeUnit = compileShaderSourceToSpirv(str, "GenCode", GLSLANG_STAGE_COMPUTE);
+    std::string str = assembleShaderSource(shaderCode, tail);
+    SpirvCache* cache = SpirvCache::get_cache();
+    SpirvCache::Key key = SpirvCache::hash_source(str, compilerOptions(GLSLANG_STAGE_COMPUTE));
+    std::vector<uint32_t> sourceCodeUnit;
+    if (!cache->find(key, sourceCodeUnit)) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        sourceCodeUnit = compileShaderSourceToSpirv(str, "GenCode", GLSLANG_STAGE_COMPUTE);
+        cache->insert(key, sourceCodeUnit);
+        std::stringstream compileMessage;
+        compileMessage << "Compiled " << str.size() << " bytes of GLSL (" << shaderCode.size() << " generated) to "
+            << sourceCodeUnit.size() * sizeof(uint32_t) << " bytes of SPIR-V in "
+            << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count() << " ms";
+        vkLogging::Logger::get_logger()->print(compileMessage.str());
+    }
     moduleInfo.codeSize = sourceCodeUnit.size() * sizeof(decltype(sourceCodeUnit)::value_type);
     moduleInfo.pCode = reinterpret_cast<const uint32_t*>(sourceCodeUnit.data());
 
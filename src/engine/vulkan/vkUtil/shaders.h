@@ -9,9 +9,11 @@ namespace vkUtil {
     std::vector<uint32_t> compileShaderSourceToSpirv(std::string& shaderSource, const std::string& inputFilename, glslang_stage_t shaderStage, bool onlyCheckCode = false, char** error = nullptr);
     
     std::vector<char> prepareShader();
-    std::vector<char> endShader(bool useForOut = false);
+    // tail is the shader resource with main(), render.comp unless baking frozen groups
+    std::vector<char> endShader(UINT tail = IDR_SHADER_RENDER);
+    std::string assembleShaderSource(const std::string& shaderCode, UINT tail = IDR_SHADER_RENDER);
 
-	vk::ShaderModule createModule(std::string shaderCode, vk::Device device, bool useForOut = false);
+	vk::ShaderModule createModule(std::string shaderCode, vk::Device device, UINT tail = IDR_SHADER_RENDER);
     std::string getExecutablePath();
     std::string getExecutableDirectory();
     std::vector<char> LoadShaderResource(UINT resourceID);
@@ -0,0 +1,191 @@
+#include "spirv_cache.h"
+#include "shaders.h"
+#include "../../logging.h"
+#include <filesystem>
+#include <algorithm>
+#include <iomanip>
+
+namespace vkUtil {
+	SpirvCache* SpirvCache::cache;
+}
+
+namespace {
+	const uint32_t cacheFileMagic = 0x43565053; // "SPVC"
+	const uint32_t cacheFileVersion = 2;
+	const uint32_t spirvMagic = 0x07230203;
+}
+
+vkUtil::SpirvCache* vkUtil::SpirvCache::get_cache() {
+	static std::once_flag created;
+	std::call_once(created, [] { cache = new SpirvCache(); });
+	return cache;
+}
+
+vkUtil::SpirvCache::SpirvCache() {
+	m_directory = getExecutableDirectory() + "/shader_cache/";
+	std::error_code ec;
+	std::filesystem::create_directories(m_directory, ec);
+	if (ec) {
+		vkLogging::Logger::get_logger()->print("Failed to create shader cache directory, SPIR-V is only cached in memory");
+		m_directory.clear();
+	}
+}
+
+vkUtil::SpirvCache::Key vkUtil::SpirvCache::hash_source(const std::string& source, const std::string& options) {
+	// FNV-1a, stable across runs and platforms unlike std::hash. The check is a
+	// different multiply-xorshift hash so a source colliding on one rarely collides on both
+	Key key;
+	key.hash = 0xcbf29ce484222325ull;
+	key.check = 0x84222325cbf29ce4ull;
+	for (const std::string* str : { &options, &source }) {
+		for (unsigned char c : *str) {
+			key.hash ^= c;
+			key.hash *= 0x100000001b3ull;
+			key.check = (key.check + c) * 0x9e3779b97f4a7c15ull;
+			key.check ^= key.check >> 29;
+		}
+		key.hash ^= 0xff; // separator, so text cannot move between options and source
+		key.hash *= 0x100000001b3ull;
+		key.check = (key.check + 0xff) * 0x9e3779b97f4a7c15ull;
+		key.check ^= key.check >> 29;
+		key.length += str->size() + 1;
+	}
+	return key;
+}
+
+bool vkUtil::SpirvCache::find(const Key& key, std::vector<uint32_t>& spirv) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_entries.find(key.hash);
+	if (it != m_entries.end() && it->second.key.check == key.check && it->second.key.length == key.length) {
+		m_lru.splice(m_lru.begin(), m_lru, it->second.lruIt);
+		spirv = it->second.spirv;
+		m_hits++;
+		return true;
+	}
+
+	if (it == m_entries.end() && read_file(key, spirv)) {
+		add_to_memory(key, spirv);
+		m_hits++;
+		return true;
+	}
+
+	m_misses++;
+	return false;
+}
+
+void vkUtil::SpirvCache::insert(const Key& key, const std::vector<uint32_t>& spirv) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (spirv.empty() || m_entries.count(key.hash)) {
+		return;
+	}
+	add_to_memory(key, spirv);
+	write_file(key, spirv);
+}
+
+void vkUtil::SpirvCache::add_to_memory(const Key& key, const std::vector<uint32_t>& spirv) {
+	m_lru.push_front(key.hash);
+	m_entries[key.hash] = { key, spirv, m_lru.begin() };
+	m_memoryBytes += spirv.size() * sizeof(uint32_t);
+
+	while (m_memoryBytes > m_maxMemoryBytes && m_lru.size() > 1) {
+		auto oldest = m_entries.find(m_lru.back());
+		m_memoryBytes -= oldest->second.spirv.size() * sizeof(uint32_t);
+		m_entries.erase(oldest);
+		m_lru.pop_back();
+	}
+}
+
+std::string vkUtil::SpirvCache::file_path(uint64_t key) {
+	std::stringstream name;
+	name << m_directory << std::hex << std::setw(16) << std::setfill('0') << key << ".spv";
+	return name.str();
+}
+
+bool vkUtil::SpirvCache::read_file(const Key& key, std::vector<uint32_t>& spirv) {
+	if (m_directory.empty()) {
+		return false;
+	}
+
+	std::string path = file_path(key.hash);
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	uint32_t magic = 0, version = 0;
+	uint64_t wordCount = 0;
+	Key stored;
+	file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	file.read(reinterpret_cast<char*>(&version), sizeof(version));
+	file.read(reinterpret_cast<char*>(&stored.hash), sizeof(stored.hash));
+	file.read(reinterpret_cast<char*>(&stored.length), sizeof(stored.length));
+	file.read(reinterpret_cast<char*>(&stored.check), sizeof(stored.check));
+	file.read(reinterpret_cast<char*>(&wordCount), sizeof(wordCount));
+	if (!file || magic != cacheFileMagic || version != cacheFileVersion || stored.hash != key.hash ||
+		stored.length != key.length || stored.check != key.check || wordCount == 0) {
+		return false;
+	}
+
+	spirv.resize(wordCount);
+	file.read(reinterpret_cast<char*>(spirv.data()), wordCount * sizeof(uint32_t));
+	if (!file || spirv[0] != spirvMagic) {
+		spirv.clear();
+		return false;
+	}
+	file.close();
+
+	// Touch the file so disk eviction sees it as recently used
+	std::error_code ec;
+	std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+	return true;
+}
+
+void vkUtil::SpirvCache::write_file(const Key& key, const std::vector<uint32_t>& spirv) {
+	if (m_directory.empty()) {
+		return;
+	}
+
+	std::ofstream file(file_path(key.hash), std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		vkLogging::Logger::get_logger()->print("Failed to write shader cache entry");
+		return;
+	}
+
+	uint64_t wordCount = spirv.size();
+	file.write(reinterpret_cast<const char*>(&cacheFileMagic), sizeof(cacheFileMagic));
+	file.write(reinterpret_cast<const char*>(&cacheFileVersion), sizeof(cacheFileVersion));
+	file.write(reinterpret_cast<const char*>(&key.hash), sizeof(key.hash));
+	file.write(reinterpret_cast<const char*>(&key.length), sizeof(key.length));
+	file.write(reinterpret_cast<const char*>(&key.check), sizeof(key.check));
+	file.write(reinterpret_cast<const char*>(&wordCount), sizeof(wordCount));
+	file.write(reinterpret_cast<const char*>(spirv.data()), wordCount * sizeof(uint32_t));
+	file.close();
+
+	trim_disk();
+}
+
+void vkUtil::SpirvCache::trim_disk() {
+	std::error_code ec;
+	std::vector<std::filesystem::directory_entry> files;
+	size_t totalBytes = 0;
+	for (auto& entry : std::filesystem::directory_iterator(m_directory, ec)) {
+		if (entry.is_regular_file(ec) && entry.path().extension() == ".spv") {
+			files.push_back(entry);
+			totalBytes += entry.file_size(ec);
+		}
+	}
+	if (totalBytes <= m_maxDiskBytes) {
+		return;
+	}
+
+	std::sort(files.begin(), files.end(), [&](const std::filesystem::directory_entry& a, const std::filesystem::directory_entry& b) {
+		return a.last_write_time(ec) < b.last_write_time(ec);
+	});
+	for (auto& file : files) {
+		if (totalBytes <= m_maxDiskBytes) {
+			break;
+		}
+		totalBytes -= file.file_size(ec);
+		std::filesystem::remove(file.path(), ec);
+	}
+}
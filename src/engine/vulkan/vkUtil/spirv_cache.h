@@ -0,0 +1,83 @@
+#pragma once
+#include "../../../common/config.h"
+#include <list>
+#include <mutex>
+#include <atomic>
+
+namespace vkUtil {
+
+	/**
+		Content addressed cache of compiled SPIR-V, keyed by a hash of the full
+		assembled shader source and the compiler that produced it. Entries live in memory and in a directory next
+		to the executable, both bounded in size with least recently used eviction.
+		Safe to use from the background compile thread and the main thread.
+	*/
+	class SpirvCache {
+	public:
+		static SpirvCache* cache;
+		static SpirvCache* get_cache();
+
+		/**
+			Identifies a shader source. Entries are stored under the hash, the length and
+			independent check hash guard against two sources sharing the hash.
+		*/
+		struct Key {
+			uint64_t hash = 0;
+			uint64_t check = 0;
+			uint64_t length = 0;
+		};
+
+		/**
+			\param source the complete shader source handed to glslang
+			\param options the glslang version and compile options the source is compiled with
+			\returns the key under which the SPIR-V for this source is stored
+		*/
+		static Key hash_source(const std::string& source, const std::string& options);
+
+		/**
+			Look up previously compiled SPIR-V, first in memory then on disk.
+
+			\param key identifies the shader source
+			\param spirv receives the cached code on a hit
+			\returns whether the key was found
+		*/
+		bool find(const Key& key, std::vector<uint32_t>& spirv);
+
+		/**
+			Store freshly compiled SPIR-V in memory and on disk.
+
+			\param key identifies the shader source
+			\param spirv the compiled code, empty results are ignored
+		*/
+		void insert(const Key& key, const std::vector<uint32_t>& spirv);
+
+		uint32_t get_hits() { return m_hits; }
+		uint32_t get_misses() { return m_misses; }
+
+	private:
+		SpirvCache();
+
+		struct Entry {
+			Key key;
+			std::vector<uint32_t> spirv;
+			std::list<uint64_t>::iterator lruIt;
+		};
+
+		static const size_t m_maxMemoryBytes = 64 * 1024 * 1024;
+		static const size_t m_maxDiskBytes = 256 * 1024 * 1024;
+
+		std::mutex m_mutex;
+		std::string m_directory;
+		std::list<uint64_t> m_lru;
+		std::unordered_map<uint64_t, Entry> m_entries;
+		size_t m_memoryBytes = 0;
+		std::atomic<uint32_t> m_hits{ 0 };
+		std::atomic<uint32_t> m_misses{ 0 };
+
+		std::string file_path(uint64_t key);
+		bool read_file(const Key& key, std::vector<uint32_t>& spirv);
+		void write_file(const Key& key, const std::vector<uint32_t>& spirv);
+		void add_to_memory(const Key& key, const std::vector<uint32_t>& spirv);
+		void trim_disk();
+	};
+}